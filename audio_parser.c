@@ -2,18 +2,543 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#ifdef AP_ENABLE_STATS
+#include <time.h>
+#endif
+
+// 平台相关：导出宏、线程、锁
+#ifdef _WIN32
+#include <windows.h>
+#define AP_EXPORT __declspec(dllexport)
+#define AP_THREAD_PROC DWORD WINAPI
+#define AP_THREAD_EXIT 0
+typedef HANDLE ap_thread;
+typedef CRITICAL_SECTION ap_mutex;
+typedef CONDITION_VARIABLE ap_cond;
+typedef DWORD (WINAPI *ap_thread_fn)(void*);
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#if defined(AP_USE_MMAP) || defined(AP_USE_IO_URING)
+#include <sys/mman.h>
+#endif
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#ifdef AP_USE_IO_URING
+#include <errno.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#define AP_EXPORT __attribute__((visibility("default")))
+#define AP_THREAD_PROC void*
+#define AP_THREAD_EXIT NULL
+typedef pthread_t ap_thread;
+typedef pthread_mutex_t ap_mutex;
+typedef pthread_cond_t ap_cond;
+typedef void* (*ap_thread_fn)(void*);
+#endif
+
+#define AP_MAX_THREADS 256
+
+#ifdef _MSC_VER
+#define AP_THREAD_LOCAL __declspec(thread)
+#else
+#define AP_THREAD_LOCAL __thread
+#endif
+
+static void ap_atomic_add64(long long* target, long long value) {
+#ifdef _MSC_VER
+    InterlockedExchangeAdd64((volatile LONG64*)target, value);
+#else
+    __atomic_fetch_add(target, value, __ATOMIC_RELAXED);
+#endif
+}
+
+static long long ap_atomic_load64(long long* target) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchange64((volatile LONG64*)target, 0, 0);
+#else
+    return __atomic_load_n(target, __ATOMIC_RELAXED);
+#endif
+}
+
+// 无锁队列用：成功返回1
+static int ap_atomic_cas64(long long* target, long long expected, long long desired) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchange64((volatile LONG64*)target, desired, expected) == expected;
+#else
+    return __atomic_compare_exchange_n(target, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+#endif
+}
+
+static long long ap_atomic_load_acquire64(long long* target) {
+#ifdef _MSC_VER
+    return InterlockedCompareExchange64((volatile LONG64*)target, 0, 0);
+#else
+    return __atomic_load_n(target, __ATOMIC_ACQUIRE);
+#endif
+}
+
+static void ap_atomic_store_release64(long long* target, long long value) {
+#ifdef _MSC_VER
+    InterlockedExchange64((volatile LONG64*)target, value);
+#else
+    __atomic_store_n(target, value, __ATOMIC_RELEASE);
+#endif
+}
+
+// 内存分配都经过这里，调用方可以换成自己的分配器（比如计数或按线程分池）
+typedef void* (*AudioMallocFn)(size_t size);
+typedef void* (*AudioReallocFn)(void* ptr, size_t size);
+typedef void (*AudioFreeFn)(void* ptr);
+
+static AudioMallocFn ap_malloc_fn = malloc;
+static AudioReallocFn ap_realloc_fn = realloc;
+static AudioFreeFn ap_free_fn = free;
+
+static void* ap_malloc(size_t size) {
+    return ap_malloc_fn(size);
+}
+
+static void* ap_calloc(size_t count, size_t size) {
+    void* ptr = ap_malloc_fn(count * size);
+    if (ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+static void* ap_realloc(void* ptr, size_t size) {
+    return ap_realloc_fn(ptr, size);
+}
+
+static void ap_free(void* ptr) {
+    if (ptr) ap_free_fn(ptr);
+}
+
+// 三个都给才生效，全为NULL时恢复标准库；要在任何其他调用之前设置，之后不能再换
+int set_audio_allocator(AudioMallocFn malloc_fn, AudioReallocFn realloc_fn, AudioFreeFn free_fn) {
+    if (!malloc_fn && !realloc_fn && !free_fn) {
+        ap_malloc_fn = malloc;
+        ap_realloc_fn = realloc;
+        ap_free_fn = free;
+        return 1;
+    }
+    if (!malloc_fn || !realloc_fn || !free_fn) return 0;
+    
+    ap_malloc_fn = malloc_fn;
+    ap_realloc_fn = realloc_fn;
+    ap_free_fn = free_fn;
+    return 1;
+}
+
+static void ap_mutex_init(ap_mutex* m) {
+#ifdef _WIN32
+    InitializeCriticalSection(m);
+#else
+    pthread_mutex_init(m, NULL);
+#endif
+}
+
+static void ap_mutex_destroy(ap_mutex* m) {
+#ifdef _WIN32
+    DeleteCriticalSection(m);
+#else
+    pthread_mutex_destroy(m);
+#endif
+}
+
+static void ap_mutex_lock(ap_mutex* m) {
+#ifdef _WIN32
+    EnterCriticalSection(m);
+#else
+    pthread_mutex_lock(m);
+#endif
+}
+
+static void ap_mutex_unlock(ap_mutex* m) {
+#ifdef _WIN32
+    LeaveCriticalSection(m);
+#else
+    pthread_mutex_unlock(m);
+#endif
+}
+
+static void ap_cond_init(ap_cond* c) {
+#ifdef _WIN32
+    InitializeConditionVariable(c);
+#else
+    pthread_cond_init(c, NULL);
+#endif
+}
+
+static void ap_cond_destroy(ap_cond* c) {
+#ifdef _WIN32
+    (void)c;
+#else
+    pthread_cond_destroy(c);
+#endif
+}
+
+static void ap_cond_wait(ap_cond* c, ap_mutex* m) {
+#ifdef _WIN32
+    SleepConditionVariableCS(c, m, INFINITE);
+#else
+    pthread_cond_wait(c, m);
+#endif
+}
+
+static void ap_cond_broadcast(ap_cond* c) {
+#ifdef _WIN32
+    WakeAllConditionVariable(c);
+#else
+    pthread_cond_broadcast(c);
+#endif
+}
+
+static void ap_cond_signal(ap_cond* c) {
+#ifdef _WIN32
+    WakeConditionVariable(c);
+#else
+    pthread_cond_signal(c);
+#endif
+}
+
+static int ap_thread_start(ap_thread* thread, ap_thread_fn fn, void* arg) {
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, fn, arg, 0, NULL);
+    return *thread != NULL;
+#else
+    return pthread_create(thread, NULL, fn, arg) == 0;
+#endif
+}
+
+static void ap_thread_join(ap_thread thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+static int ap_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (int)si.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+// 编码类型
+#define AUDIO_CODEC_UNKNOWN 0
+#define AUDIO_CODEC_PCM     1
+#define AUDIO_CODEC_FLAC    2
+#define AUDIO_CODEC_VORBIS  3
+#define AUDIO_CODEC_OPUS    4
+#define AUDIO_CODEC_MP1     5
+#define AUDIO_CODEC_MP2     6
+#define AUDIO_CODEC_MP3     7
+
+// 错误码
+#define AUDIO_OK                 0
+#define AUDIO_ERR_INVALID_ARG    1
+#define AUDIO_ERR_OPEN           2
+#define AUDIO_ERR_UNKNOWN_FORMAT 3
+#define AUDIO_ERR_PARSE          4
+
+// 导出的流信息结构体。调用方在struct_size里填sizeof，库只写这么多字节，
+// 以后在末尾加字段时老调用方不受影响
+#define AUDIO_STREAM_INFO_VERSION 3
+
+typedef struct {
+    unsigned int struct_size;
+    unsigned int version;           // 库填写的结构体版本
+    int error;                      // AUDIO_OK 或 AUDIO_ERR_*
+    int codec;                      // AUDIO_CODEC_*
+    unsigned int sample_rate;
+    unsigned int channels;
+    unsigned int bits_per_sample;   // 有损格式为0
+    unsigned int bitrate;           // 平均比特率 (bps)
+    int is_vbr;
+    int estimated;                  // 版本3起（原reserved）：1表示样本数由平均帧长推算（无Xing头的CBR MP3），不是精确值
+    unsigned long long total_samples;   // 可播放的样本数（每声道），已扣除下面两项
+    double duration;                // 秒
+    // 版本2
+    unsigned long long duration_ns; // 由total_samples整数换算，不经过浮点
+    unsigned int leading_samples;   // 开头要丢弃的样本：MP3编码器延迟、Opus pre-skip
+    unsigned int trailing_samples;  // 末尾要丢弃的填充样本：MP3编码器填充
+} AudioStreamInfo;
+
+// 限定读盘量的时长估算结果，struct_size约定同AudioStreamInfo
+#define AUDIO_DURATION_ESTIMATE_VERSION 1
+
+typedef struct {
+    unsigned int struct_size;
+    unsigned int version;
+    int error;                      // AUDIO_OK 或 AUDIO_ERR_*
+    int exact;                      // 1：由头部字段或完整遍历得出的精确值；0：估算值
+    double duration;                // 秒
+    double error_bound;             // 估算误差范围（秒），由采样分布推出，精确值时为0
+    long long bytes_read;           // 实际读盘字节数，不超过预算
+} AudioDurationEstimate;
+
+// 自定义I/O：数据不在本地文件里（对象存储的区间读取网关等）时由调用方提供读取回调
+// read_at返回实际读到的字节数（到末尾可以少于len），出错返回-1；size返回总长度，出错返回-1
+// 回调只在发起解析的线程上、在这次调用返回之前被调用
+typedef long long (*AudioReadAtFn)(void* user, long long offset, void* buffer, size_t len);
+typedef long long (*AudioSizeFn)(void* user);
+
+// 预取策略：打开时先取头部（WAV头、FLAC的STREAMINFO、MP3的Xing帧都在这里），
+// 之后缺哪段补哪段，每次至少request_bytes，靠近末尾的请求一直延伸到文件尾（Ogg末页、ID3v1）。
+// 头尾加起来不比一次请求大多少的小文件一次取完。字段为0取默认值；struct_size约定同AudioStreamInfo
+typedef struct {
+    unsigned int struct_size;
+    unsigned int head_bytes;        // 打开时预取的开头字节数，默认64KB
+    unsigned int tail_bytes;        // 打开时一并预取的末尾字节数，默认0（用到时再取）
+    unsigned int request_bytes;     // 补读时单次请求的最小字节数，默认64KB
+    AudioReadAtFn read_at;
+    AudioSizeFn size;
+    void* user;
+} AudioIO;
+
+// 链式Ogg每一节的信息，GetOggLinks按调用方给的每项大小回填
+typedef struct {
+    long long offset;                   // 本节在文件中的起始位置
+    long long size;                     // 本节字节数
+    unsigned int serial;                // 音频流的序列号
+    int codec;                          // AUDIO_CODEC_VORBIS / AUDIO_CODEC_OPUS
+    unsigned int sample_rate;
+    unsigned int channels;
+    unsigned int stream_count;          // 本节复用的逻辑流个数（0表示太多没有记全）
+    unsigned int leading_samples;       // Opus pre-skip
+    unsigned long long total_samples;   // 本节可播放的样本数
+    double duration;                    // 秒
+} AudioOggLink;
+
+// 跳转索引的一个点：从offset开始读，解出的第一个样本是sample（按索引的采样率计，从可播放的第一个样本算起）
+typedef struct {
+    unsigned long long sample;
+    long long offset;
+} AudioSeekPoint;
+
+// 跳转索引的概况，struct_size约定同AudioStreamInfo
+#define AUDIO_SEEK_INDEX_INFO_VERSION 1
+
+typedef struct {
+    unsigned int struct_size;
+    unsigned int version;
+    int codec;                          // AUDIO_CODEC_*
+    unsigned int sample_rate;           // sample的单位；链式Ogg为第一节的采样率
+    unsigned int point_count;
+    int exact;                          // 1：每个点都在页/帧起点上；0：由MP3的Xing/VBRI目录换算的近似位置
+    unsigned long long total_samples;
+    long long file_size;                // 建索引时音频文件的大小，和现在对不上说明索引已过期
+    double duration;                    // 秒
+} AudioSeekIndexInfo;
+
+#define AUDIO_SEEK_EXACT 0x1            // BuildMp3SeekIndex：不用Xing/VBRI目录，逐帧建精确的表
+
+// 解析统计：编译时定义AP_ENABLE_STATS才采集，否则下面的宏全部为空，热路径上没有任何开销
+// 每个线程记录自己最近一次调用，另有一份所有线程累加的总数
+#define AP_STRATEGY_NONE         0
+#define AP_STRATEGY_HEADER       1    // WAV的data块/FLAC的STREAMINFO直接给出
+#define AP_STRATEGY_XING         2    // MP3 Xing/Info/VBRI头中的帧数
+#define AP_STRATEGY_CBR_ESTIMATE 3    // MP3按前几帧和文件大小估算
+#define AP_STRATEGY_FULL_WALK    4    // MP3逐帧遍历
+#define AP_STRATEGY_OGG_TAIL     5    // Ogg头部+尾部
+#define AP_STRATEGY_OGG_SCAN     6    // Ogg整段遍历
+#define AP_STRATEGY_CACHE        7    // 命中时长缓存
+#define AP_STRATEGY_ESTIMATE     8    // 限定读盘量的采样估算
+#define AP_STRATEGY_FLAC_TAIL    9    // FLAC总样本数为0，由SEEKTABLE/文件尾的最后一帧推出
+#define AP_STRATEGY_COUNT        16   // 预留，新增策略不改结构体布局
+
+#define AP_PHASE_OPEN  0
+#define AP_PHASE_SNIFF 1
+#define AP_PHASE_PARSE 2
+
+#define AUDIO_PARSE_STATS_VERSION 1
+
+typedef struct {
+    unsigned int struct_size;
+    unsigned int version;
+    int strategy;                   // 本次调用用到的时长策略；累计统计里为0，看strategy_counts
+    int reserved;
+    long long calls;                // 顶层调用数（批量流水线整批算一次）
+    long long files;                // 打开的文件/缓冲区数
+    long long bytes_read;
+    long long reads;
+    long long seeks;                // 不紧接上一次读的读
+    long long frames;               // 访问的MP3帧、Ogg页、FLAC元数据块、WAV块
+    long long resync_bytes;         // MP3丢失同步后跳过的字节
+    long long strategy_counts[AP_STRATEGY_COUNT];
+    long long open_ns;
+    long long sniff_ns;
+    long long parse_ns;
+    long long total_ns;
+} AudioParseStats;
+
+#define AP_STATS_FIRST_COUNTER offsetof(AudioParseStats, calls)
+#define AP_STATS_COUNTERS ((sizeof(AudioParseStats) - AP_STATS_FIRST_COUNTER) / sizeof(long long))
+
+#ifdef AP_ENABLE_STATS
+typedef struct {
+    AudioParseStats current;
+    AudioParseStats last;           // 本线程最近一次完成的调用
+    int depth;                      // 嵌套层数，最外层结束时才算一次调用
+    int phase;
+    long long phase_start;
+    long long call_start;
+    long long next_read;            // 上一次读的结束位置，用来判断是否跳读
+} ApCallStats;
+
+static AP_THREAD_LOCAL ApCallStats ap_call_stats;
+static AudioParseStats ap_total_stats;
+
+static long long ap_now_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (long long)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+static void ap_atomic_store64(long long* target, long long value) {
+#ifdef _MSC_VER
+    InterlockedExchange64((volatile LONG64*)target, value);
+#else
+    __atomic_store_n(target, value, __ATOMIC_RELAXED);
+#endif
+}
+
+static long long* ap_stats_counter(AudioParseStats* stats, size_t i) {
+    return (long long*)((char*)stats + AP_STATS_FIRST_COUNTER) + i;
+}
+
+static void ap_stats_begin(void) {
+    ApCallStats* s = &ap_call_stats;
+    s->current.files++;
+    if (s->depth++ > 0) return;
+    
+    long long now = ap_now_ns();
+    memset(&s->current, 0, sizeof(AudioParseStats));
+    s->current.files = 1;
+    s->phase = AP_PHASE_OPEN;
+    s->phase_start = now;
+    s->call_start = now;
+    s->next_read = -1;
+}
+
+static void ap_stats_phase(int phase) {
+    ApCallStats* s = &ap_call_stats;
+    if (s->depth == 0 || s->phase == phase) return;
+    
+    long long now = ap_now_ns();
+    long long elapsed = now - s->phase_start;
+    if (s->phase == AP_PHASE_OPEN) s->current.open_ns += elapsed;
+    else if (s->phase == AP_PHASE_SNIFF) s->current.sniff_ns += elapsed;
+    else s->current.parse_ns += elapsed;
+    s->phase = phase;
+    s->phase_start = now;
+}
+
+static void ap_stats_read(long long offset, long long got) {
+    ApCallStats* s = &ap_call_stats;
+    s->current.reads++;
+    if (got > 0) s->current.bytes_read += got;
+    if (offset != s->next_read) s->current.seeks++;
+    s->next_read = offset + (got > 0 ? got : 0);
+}
+
+static void ap_stats_strategy(int strategy) {
+    ap_call_stats.current.strategy = strategy;
+    ap_call_stats.current.strategy_counts[strategy]++;
+}
+
+static void ap_stats_end(void) {
+    ApCallStats* s = &ap_call_stats;
+    if (s->depth == 0) return;
+    if (s->depth > 1) {
+        s->depth--;
+        return;
+    }
+    
+    ap_stats_phase(-1);
+    s->depth = 0;
+    s->current.calls = 1;
+    s->current.total_ns = ap_now_ns() - s->call_start;
+    s->current.struct_size = sizeof(AudioParseStats);
+    s->current.version = AUDIO_PARSE_STATS_VERSION;
+    s->last = s->current;
+    
+    for (size_t i = 0; i < AP_STATS_COUNTERS; i++) {
+        long long value = *ap_stats_counter(&s->current, i);
+        if (value) ap_atomic_add64(ap_stats_counter(&ap_total_stats, i), value);
+    }
+}
+
+#define AP_STAT_BEGIN()          ap_stats_begin()
+#define AP_STAT_END()            ap_stats_end()
+#define AP_STAT_PHASE(phase)     ap_stats_phase(phase)
+#define AP_STAT_READ(offset, n)  ap_stats_read(offset, n)
+#define AP_STAT_ADD(field, n)    (ap_call_stats.current.field += (n))
+#define AP_STAT_STRATEGY(s)      ap_stats_strategy(s)
+#else
+#define AP_STAT_BEGIN()          ((void)0)
+#define AP_STAT_END()            ((void)0)
+#define AP_STAT_PHASE(phase)     ((void)0)
+#define AP_STAT_READ(offset, n)  ((void)0)
+#define AP_STAT_ADD(field, n)    ((void)sizeof(n))
+#define AP_STAT_STRATEGY(s)      ((void)sizeof(s))
+#endif
 
 // OGG相关定义
 #define OGG_PAGE_HEADER "OggS"
+#define OGG_PAGE_HEADER_SIZE 27
+#define OGG_MAX_PAGE_SIZE    (27 + 255 + 255 * 255)
+#define OGG_TAIL_WINDOW      8192                      // 尾部扫描初始窗口
+#define OGG_TAIL_MAX_WINDOW  (OGG_MAX_PAGE_SIZE * 4)   // 窗口最多扩到这么大，再不行就整段遍历
+#define OGG_GRANULE_NONE     0xFFFFFFFFFFFFFFFFULL     // 本页没有结束的包
 
 typedef struct {
     long long file_size;
     unsigned int sample_rate;
+    unsigned int channels;
+    int codec;                    // AUDIO_CODEC_VORBIS / AUDIO_CODEC_OPUS
+    unsigned int bitstream_serial;
     unsigned int total_pages;
+    unsigned int pre_skip;        // Opus开头要丢弃的样本数
+    long long start_granule;      // 第一个样本的granule，从中途截取的流不为0
     long long first_granule_position;
     long long last_granule_position;
+    long long total_samples;
+    double duration;
+    int link_count;               // 链式Ogg的节数
 } OGGInfo;
 
+// 链式Ogg的一节：各逻辑流的BOS页集中在开头，节与节在文件里前后相接、互不交错
+#define OGG_MAX_LINK_STREAMS 32
+#define OGG_ANY_SERIAL       (-1LL)
+
+typedef struct {
+    long long begin;              // 本节第一页的位置
+    long long data_start;         // BOS页组之后第一页的位置
+    unsigned int serials[OGG_MAX_LINK_STREAMS];
+    int serial_count;             // -1表示流太多记不下，此时当作一直到文件尾
+    OGGInfo info;                 // 本节音频流
+} OGGLink;
+
 typedef struct {
     unsigned char capture_pattern[4];
     unsigned char version;
@@ -28,14 +553,29 @@ typedef struct {
 // FLAC相关定义
 #define FLAC_SIGNATURE "fLaC"
 
+#define FLAC_MAX_FRAME_HEADER 16                  // 同步码到CRC-8最长16字节
+#define FLAC_TAIL_WINDOW      (64 * 1024)         // 往回找最后一帧的初始窗口
+#define FLAC_TAIL_MAX_WINDOW  (4 * 1024 * 1024)   // 窗口最多扩到这么大
+#define FLAC_TAIL_CANDIDATES  64                  // 认出末帧之前记下的候选帧头，再多就是数据坏了
+
 typedef struct {
     unsigned int sample_rate;
     unsigned int channels;
     unsigned int bits_per_sample;
+    unsigned int max_block_size;  // 固定块大小的流里帧号乘它就是起始样本
     unsigned long long total_samples;
+    long long audio_offset;       // 元数据块之后第一帧的偏移
+    unsigned long long seek_sample;   // SEEKTABLE最后一个有效点，总样本数为0时才读
+    long long seek_offset;        // 该点的帧在文件中的位置，0表示没有
     double duration;
 } FLACInfo;
 
+typedef struct {
+    int variable;                 // 可变块大小：number是起始样本号；否则是帧号
+    unsigned long long number;
+    unsigned int block_size;
+} FLACFrameHeader;
+
 // MP3相关定义
 typedef struct {
     double mpeg_version;
@@ -45,6 +585,7 @@ typedef struct {
     int frame_size;
     int padding;
     int protection;
+    int channel_mode;     // 3 = 单声道
 } MP3FrameHeader;
 
 typedef struct {
@@ -52,8 +593,32 @@ typedef struct {
     int sample_rate;
     int bitrate;
     int is_vbr;
+    int layer;
+    int channels;
+    long long total_samples;
+    int leading_samples;  // LAME头里的编码器延迟，已从total_samples扣除
+    int trailing_samples; // LAME头里的填充
+    int estimated;        // 帧数由音频区长度除以平均帧长得出
 } MP3Info;
 
+// Xing/Info/VBRI/LAME头部信息
+#define MP3_VBR_NONE 0
+#define MP3_VBR_XING 1
+#define MP3_VBR_INFO 2
+#define MP3_VBR_VBRI 3
+
+typedef struct {
+    int type;
+    unsigned int frames;        // 音频帧数（不含信息帧本身），0 = 未给出
+    unsigned int bytes;         // 音频字节数，0 = 未给出
+    int has_toc;
+    unsigned char toc[100];     // Xing TOC，仅type为Xing/Info时有效
+    int has_lame;
+    int encoder_delay;
+    int encoder_padding;
+    unsigned int music_length;  // LAME扩展里的音频长度（字节）
+} MP3VBRHeader;
+
 // WAV相关定义
 #define WAV_RIFF_HEADER "RIFF"
 #define WAV_WAVE_HEADER "WAVE"
@@ -68,122 +633,487 @@ typedef struct {
     double duration;
 } WAVInfo;
 
-// WAV函数
-static int parse_wav_file(const char* filename, WAVInfo* info) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) return 0;
-    
-    memset(info, 0, sizeof(WAVInfo));
+// 块读取层：按对齐的大块读入，解析器只拿带边界检查的字节区间
+#define READER_BLOCK_SIZE 65536     // 块缓冲区大小，能容下一整个Ogg页
+#define READER_MIN_READ   16384     // 随机访问时的读取量，顺序读时逐次翻倍
+#define READER_ALIGN      4096
+
+#define READER_FILE     0
+#define READER_MMAP     1
+#define READER_MEMORY   2
+#define READER_CALLBACK 3           // 调用方的AudioIO回调，只按区间读
+
+#define READER_MAX_SEGMENTS 4       // 预取区间个数上限（头、尾和若干次补读）
+#define READER_MAX_PREFETCH (16 * 1024 * 1024)  // 自定义I/O单个预取区间的上限
+
+// 解析上下文：持有块缓冲区，在同一线程上反复解析时不再分配内存
+// 进入上下文后本线程打开的读取器借用它的缓冲区；嵌套打开（缓冲区已被借走）时照常分配
+typedef struct {
+    unsigned char* block;
+    int block_busy;
+} ParserContext;
+
+static AP_THREAD_LOCAL ParserContext* ap_active_context;
+
+// 预先读好的一段文件内容，批量流水线异步填充
+typedef struct {
+    long long offset;
+    size_t len;
+    unsigned char* data;
+} ReaderSegment;
+
+typedef struct {
+    int backend;
+    long long size;               // 数据总长度
+    const unsigned char* base;    // MMAP/MEMORY：整段数据
+    unsigned char* block;         // FILE：块缓冲区
+    long long block_offset;       // 块缓冲区对应的文件偏移
+    size_t block_len;             // 块缓冲区中的有效字节数
+    size_t read_size;             // 下次未命中时的读取量
+    ReaderSegment segments[READER_MAX_SEGMENTS];
+    int segment_count;
+    int nonblocking;              // 置位时未命中不读盘，只记下第一个缺的区间
+    long long miss_offset;
+    size_t miss_len;              // 0表示没有未命中
+    long long budget;             // 读盘字节上限，0表示不限；超出预算的访问返回NULL
+    long long bytes_read;         // 块缓冲区累计读入的字节数
+    ParserContext* context;       // 块缓冲区借自这个上下文，关闭时归还而不释放
+    const AudioIO* io;            // CALLBACK：已补齐默认值的回调和预取策略
+    int io_error;                 // CALLBACK：read_at报过错，结果不可信
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+} BlockReader;
+
+static long long reader_read_at(BlockReader* r, long long offset, unsigned char* buffer, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        if (r->backend == READER_CALLBACK) {
+            long long got = r->io->read_at(r->io->user, offset + (long long)total, buffer + total, len - total);
+            if (got < 0 || (unsigned long long)got > len - total) r->io_error = 1;
+            if (got <= 0 || (unsigned long long)got > len - total) break;
+            total += (size_t)got;
+            continue;
+        }
+#ifdef _WIN32
+        OVERLAPPED ov;
+        DWORD got = 0;
+        memset(&ov, 0, sizeof(ov));
+        ov.Offset = (DWORD)((offset + total) & 0xFFFFFFFF);
+        ov.OffsetHigh = (DWORD)((unsigned long long)(offset + total) >> 32);
+        if (!ReadFile(r->file, buffer + total, (DWORD)(len - total), &got, &ov) || got == 0) break;
+#else
+        ssize_t got = pread(r->fd, buffer + total, len - total, (off_t)(offset + total));
+        if (got <= 0) break;
+#endif
+        total += (size_t)got;
+    }
+    AP_STAT_READ(offset, (long long)total);
+    return (long long)total;
+}
+
+// 重新取文件当前长度（FILE后端），失败返回-1
+static long long reader_file_size(const BlockReader* r) {
+#ifdef _WIN32
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(r->file, &size)) return -1;
+    return size.QuadPart;
+#else
+    struct stat st;
+    if (fstat(r->fd, &st) != 0) return -1;
+    return (long long)st.st_size;
+#endif
+}
+
+// 直接在调用方内存上解析，不拷贝
+static void reader_init_memory(BlockReader* r, const void* data, size_t size) {
+    memset(r, 0, sizeof(BlockReader));
+    r->backend = READER_MEMORY;
+    r->base = (const unsigned char*)data;
+    r->size = (long long)size;
+    AP_STAT_BEGIN();
+    AP_STAT_PHASE(AP_PHASE_PARSE);
+}
+
+// 块缓冲区优先借本线程当前的解析上下文
+static int reader_alloc_block(BlockReader* r) {
+    ParserContext* context = ap_active_context;
+    if (context && !context->block_busy) {
+        context->block_busy = 1;
+        r->context = context;
+        r->block = context->block;
+    } else {
+        r->block = (unsigned char*)ap_malloc(READER_BLOCK_SIZE);
+    }
+    return r->block != NULL;
+}
+
+// allow_map为0时总是块读取：限定读盘量时缺页读入的量无从统计，文件还在增长时映射的长度也会过时
+static int reader_open_handle(BlockReader* r, const char* filename, int allow_map) {
+    memset(r, 0, sizeof(BlockReader));
+    r->backend = READER_FILE;
+
+#ifdef _WIN32
+    r->file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (r->file == INVALID_HANDLE_VALUE) return 0;
     
-    // 读取RIFF头
-    char riff_header[4];
-    if (fread(riff_header, 1, 4, file) != 4) {
-        fclose(file);
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(r->file, &size)) {
+        CloseHandle(r->file);
         return 0;
     }
+    r->size = size.QuadPart;
+#else
+    r->fd = open(filename, O_RDONLY);
+    if (r->fd < 0) return 0;
     
-    if (memcmp(riff_header, WAV_RIFF_HEADER, 4) != 0) {
-        fclose(file);
+    struct stat st;
+    if (fstat(r->fd, &st) != 0) {
+        close(r->fd);
+        return 0;
+    }
+    r->size = (long long)st.st_size;
+#endif
+
+#ifdef AP_USE_MMAP
+    // 可选的mmap后端，映射失败就退回块读取
+    if (allow_map && r->size > 0 && (unsigned long long)r->size <= (size_t)-1) {
+#ifdef _WIN32
+        r->mapping = CreateFileMappingA(r->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (r->mapping) {
+            r->base = (const unsigned char*)MapViewOfFile(r->mapping, FILE_MAP_READ, 0, 0, 0);
+            if (!r->base) {
+                CloseHandle(r->mapping);
+                r->mapping = NULL;
+            }
+        }
+#else
+        void* map = mmap(NULL, (size_t)r->size, PROT_READ, MAP_PRIVATE, r->fd, 0);
+        if (map != MAP_FAILED) r->base = (const unsigned char*)map;
+#endif
+        if (r->base) {
+            r->backend = READER_MMAP;
+            return 1;
+        }
+    }
+#else
+    (void)allow_map;
+#endif
+
+    if (!reader_alloc_block(r)) {
+#ifdef _WIN32
+        CloseHandle(r->file);
+#else
+        close(r->fd);
+#endif
+        return 0;
+    }
+    r->read_size = READER_MIN_READ;
+    return 1;
+}
+
+// 打开文件算一次调用的开始，reader_close算结束
+static int reader_open_bounded(BlockReader* r, const char* filename, long long budget) {
+    AP_STAT_BEGIN();
+    if (!reader_open_handle(r, filename, budget == 0)) {
+        AP_STAT_END();
         return 0;
     }
+    r->budget = budget;
+    AP_STAT_PHASE(AP_PHASE_PARSE);
+    return 1;
+}
+
+static int reader_open_file(BlockReader* r, const char* filename) {
+    return reader_open_bounded(r, filename, 0);
+}
+
+// 用一次请求把[offset, offset + len)读进新的预取区间；区间数用完或读失败返回0
+static int reader_fetch_segment(BlockReader* r, long long offset, size_t len) {
+    if (r->segment_count >= READER_MAX_SEGMENTS || len == 0) return 0;
     
-    // 跳过文件大小
-    fseek(file, 4, SEEK_CUR);
+    ReaderSegment* segment = &r->segments[r->segment_count];
+    segment->data = (unsigned char*)ap_malloc(len);
+    if (!segment->data) return 0;
     
-    // 读取WAVE头
-    char wave_header[4];
-    if (fread(wave_header, 1, 4, file) != 4) {
-        fclose(file);
+    long long got = reader_read_at(r, offset, segment->data, len);
+    segment->offset = offset;
+    segment->len = got > 0 ? (size_t)got : 0;
+    r->segment_count++;
+    return got > 0;
+}
+
+// 补读缺的区间：按对齐和请求粒度放大，够到文件尾时整段往前挪，一次把尾部取全
+static int reader_fetch_miss(BlockReader* r, long long offset, size_t len) {
+    long long start = offset & ~(long long)(READER_ALIGN - 1);
+    size_t want = r->io->request_bytes;
+    if ((size_t)(offset - start) + len > want) want = (size_t)(offset - start) + len;
+    if (start + (long long)want > r->size) {
+        start = r->size - (long long)want;
+        if (start < 0) start = 0;
+        want = (size_t)(r->size - start);
+    }
+    return reader_fetch_segment(r, start, want);
+}
+
+// io必须已补齐默认值，且在读取器关闭前一直有效
+static int reader_open_io(BlockReader* r, const AudioIO* io) {
+    AP_STAT_BEGIN();
+    memset(r, 0, sizeof(BlockReader));
+    r->backend = READER_CALLBACK;
+    r->io = io;
+    r->size = io->size(io->user);
+    if (r->size < 0 || !reader_alloc_block(r)) {
+        AP_STAT_END();
         return 0;
     }
+    r->read_size = READER_BLOCK_SIZE;
     
-    if (memcmp(wave_header, WAV_WAVE_HEADER, 4) != 0) {
-        fclose(file);
-        return 0;
+    // 头尾之间的空隙不到一次请求就并成一次
+    long long head = io->head_bytes;
+    long long tail = io->tail_bytes;
+    if (head + tail + (long long)io->request_bytes >= r->size) {
+        reader_fetch_segment(r, 0, (size_t)r->size);
+    } else {
+        reader_fetch_segment(r, 0, (size_t)head);
+        if (tail > 0) reader_fetch_segment(r, r->size - tail, (size_t)tail);
+    }
+    AP_STAT_PHASE(AP_PHASE_PARSE);
+    return 1;
+}
+
+static void reader_close(BlockReader* r) {
+    AP_STAT_END();
+    if (r->backend == READER_MEMORY) return;
+
+#ifdef AP_USE_MMAP
+    if (r->backend == READER_MMAP) {
+#ifdef _WIN32
+        UnmapViewOfFile(r->base);
+        CloseHandle(r->mapping);
+#else
+        munmap((void*)r->base, (size_t)r->size);
+#endif
+    }
+#endif
+
+    if (r->context) {
+        r->context->block_busy = 0;
+        r->context = NULL;
+    } else {
+        ap_free(r->block);
+    }
+    r->block = NULL;
+    for (int i = 0; i < r->segment_count; i++) {
+        ap_free(r->segments[i].data);
+    }
+    r->segment_count = 0;
+    if (r->backend == READER_CALLBACK) return;
+#ifdef _WIN32
+    CloseHandle(r->file);
+#else
+    close(r->fd);
+#endif
+}
+
+static const ReaderSegment* reader_find_segment(const BlockReader* r, long long offset, size_t len) {
+    for (int i = 0; i < r->segment_count; i++) {
+        const ReaderSegment* segment = &r->segments[i];
+        if (offset >= segment->offset && offset + (long long)len <= segment->offset + (long long)segment->len) {
+            return segment;
+        }
+    }
+    return NULL;
+}
+
+// [offset, offset + len)已在内存里（映射、当前块或预取的分段），取它不会再读盘
+static int reader_cached(const BlockReader* r, long long offset, size_t len) {
+    if (offset < 0 || offset + (long long)len > r->size) return 0;
+    if (r->base) return 1;
+    if (offset >= r->block_offset && offset + (long long)len <= r->block_offset + (long long)r->block_len) return 1;
+    return reader_find_segment(r, offset, len) != NULL;
+}
+
+// 返回[offset, offset + len)的只读指针，越界或读失败返回NULL
+// 指针只在下一次调用reader_span/reader_window之前有效
+static const unsigned char* reader_span(BlockReader* r, long long offset, size_t len) {
+    if (offset < 0 || len > READER_BLOCK_SIZE || offset + (long long)len > r->size) return NULL;
+    
+    if (r->base) return r->base + offset;
+    
+    if (offset >= r->block_offset && offset + (long long)len <= r->block_offset + (long long)r->block_len) {
+        return r->block + (offset - r->block_offset);
     }
     
-    // 查找fmt块
-    int found_fmt = 0;
-    char chunk_header[4];
-    unsigned int chunk_size;
+    const ReaderSegment* segment = reader_find_segment(r, offset, len);
+    if (segment) return segment->data + (offset - segment->offset);
     
-    while (fread(chunk_header, 1, 4, file) == 4) {
-        if (fread(&chunk_size, 4, 1, file) != 1) {
-            fclose(file);
-            return 0;
-        }
-        
-        if (memcmp(chunk_header, WAV_FMT_HEADER, 4) == 0) {
-            found_fmt = 1;
-            break;
+    // 非阻塞模式下记下缺的区间，之后的访问一律失败，让解析尽快返回
+    if (r->nonblocking) {
+        if (r->miss_len == 0) {
+            r->miss_offset = offset;
+            r->miss_len = len > 0 ? len : 1;
         }
-        
-        // 跳过当前块
-        fseek(file, chunk_size, SEEK_CUR);
+        return NULL;
     }
     
-    if (!found_fmt) {
-        fclose(file);
-        return 0;
+    // 紧接着上一块继续读（或从块尾跨出去）时视为顺序访问，读取量翻倍
+    if (r->block_len > 0 && offset >= r->block_offset &&
+        offset < r->block_offset + (long long)r->block_len + READER_ALIGN) {
+        r->read_size *= 2;
+        if (r->read_size > READER_BLOCK_SIZE) r->read_size = READER_BLOCK_SIZE;
+    } else {
+        // 远端请求的往返延迟远大于传输时间，自定义I/O未命中时总是读满一块
+        r->read_size = r->backend == READER_CALLBACK ? READER_BLOCK_SIZE : READER_MIN_READ;
     }
     
-    // 读取fmt块数据
-    unsigned short audio_format;
-    if (fread(&audio_format, 2, 1, file) != 1) {
-        fclose(file);
-        return 0;
-    }
+    long long start = offset & ~(long long)(READER_ALIGN - 1);
+    if ((size_t)(offset - start) + len > READER_BLOCK_SIZE) start = offset;
     
-    // 只支持PCM格式
-    if (audio_format != 1) {
-        fclose(file);
-        return 0;
+    size_t want = r->read_size;
+    if ((size_t)(offset - start) + len > want) want = (size_t)(offset - start) + len;
+    
+    // 有预算时单次最多读预算的四分之一（给后面的窗口留余量）且不超过剩余预算，
+    // 连所需区间都放不下就当读不到
+    if (r->budget > 0) {
+        long long remaining = r->budget - r->bytes_read;
+        if ((long long)len > remaining) return NULL;
+        
+        long long cap = r->budget / 4;
+        if (cap < (long long)len) cap = (long long)len;
+        if (cap > remaining) cap = remaining;
+        if ((long long)want > cap) {
+            if ((long long)(offset - start) + (long long)len > cap) start = offset;
+            want = (size_t)cap;
+        }
     }
+    if (start + (long long)want > r->size) want = (size_t)(r->size - start);
     
-    unsigned short num_channels;
-    if (fread(&num_channels, 2, 1, file) != 1) {
-        fclose(file);
-        return 0;
+    long long got = reader_read_at(r, start, r->block, want);
+    r->block_offset = start;
+    r->block_len = got > 0 ? (size_t)got : 0;
+    r->bytes_read += (long long)r->block_len;
+    
+    if (offset + (long long)len > start + (long long)r->block_len) return NULL;
+    return r->block + (offset - start);
+}
+
+// 返回从offset开始尽可能长的一段连续数据（至少min_len字节），*avail为可用长度
+static const unsigned char* reader_window(BlockReader* r, long long offset, size_t min_len, size_t* avail) {
+    const unsigned char* p = reader_span(r, offset, min_len);
+    if (!p) return NULL;
+    
+    if (r->base) {
+        *avail = (size_t)(r->size - offset);
+    } else if (p >= r->block && p < r->block + r->block_len) {
+        *avail = (size_t)(r->block_offset + (long long)r->block_len - offset);
+    } else {
+        const ReaderSegment* segment = reader_find_segment(r, offset, min_len);
+        *avail = (size_t)(segment->offset + (long long)segment->len - offset);
     }
+    return p;
+}
+
+static unsigned int read_le16(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8);
+}
+
+static unsigned int read_le32(const unsigned char* p) {
+    return (unsigned int)p[0] | ((unsigned int)p[1] << 8) |
+           ((unsigned int)p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static unsigned int read_be32(const unsigned char* p) {
+    return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) |
+           ((unsigned int)p[2] << 8) | (unsigned int)p[3];
+}
+
+// 跳过ID3v2标签，返回第一个音频字节的偏移
+static long long skip_id3v2_tag(BlockReader* r) {
+    const unsigned char* header = reader_span(r, 0, 10);
+    if (!header) return 0;
     
-    unsigned int sample_rate;
-    if (fread(&sample_rate, 4, 1, file) != 1) {
-        fclose(file);
-        return 0;
+    if (memcmp(header, "ID3", 3) == 0) {
+        // 计算ID3v2标签大小
+        long long size = 0;
+        for (int i = 6; i < 10; i++) {
+            size = size * 128 + (header[i] & 0x7F);
+        }
+        // 带尾部标记的标签再多10字节
+        if (header[5] & 0x10) size += 10;
+        return 10 + size;
     }
+    return 0;
+}
+
+// 有的打标签工具不分格式，在FLAC/WAV前面也加ID3v2标签：签名在开头或紧跟标签之后，
+// 返回签名的位置，都不是返回-1
+static long long find_signature(BlockReader* r, const char* magic) {
+    const unsigned char* p = reader_span(r, 0, 4);
+    if (p && memcmp(p, magic, 4) == 0) return 0;
+    
+    long long start = skip_id3v2_tag(r);
+    if (start <= 0) return -1;
+    p = reader_span(r, start, 4);
+    return p && memcmp(p, magic, 4) == 0 ? start : -1;
+}
+
+// WAV函数
+static int parse_wav(BlockReader* r, WAVInfo* info) {
+    memset(info, 0, sizeof(WAVInfo));
     
-    // 跳过字节率和块对齐
-    fseek(file, 6, SEEK_CUR);
+    // 读取RIFF/WAVE头
+    long long base = find_signature(r, WAV_RIFF_HEADER);
+    if (base < 0) return 0;
+    const unsigned char* riff = reader_span(r, base, 12);
+    if (!riff) return 0;
     
-    unsigned short bits_per_sample;
-    if (fread(&bits_per_sample, 2, 1, file) != 1) {
-        fclose(file);
+    if (memcmp(riff, WAV_RIFF_HEADER, 4) != 0 || memcmp(riff + 8, WAV_WAVE_HEADER, 4) != 0) {
         return 0;
     }
     
-    // 查找data块
-    fseek(file, chunk_size - 16, SEEK_CUR); // 跳过fmt块的剩余部分
-    
+    // 依次查找fmt块和data块
+    int found_fmt = 0;
     int found_data = 0;
+    unsigned int audio_format = 0;
+    unsigned int num_channels = 0;
+    unsigned int sample_rate = 0;
+    unsigned int bits_per_sample = 0;
     unsigned int data_size = 0;
+    long long pos = base + 12;
     
-    while (fread(chunk_header, 1, 4, file) == 4) {
-        if (fread(&chunk_size, 4, 1, file) != 1) {
-            fclose(file);
-            return 0;
-        }
+    while (!found_data) {
+        const unsigned char* chunk = reader_span(r, pos, 8);
+        if (!chunk) break;
+        AP_STAT_ADD(frames, 1);
         
-        if (memcmp(chunk_header, WAV_DATA_HEADER, 4) == 0) {
-            found_data = 1;
+        unsigned int chunk_size = read_le32(chunk + 4);
+        
+        if (memcmp(chunk, WAV_FMT_HEADER, 4) == 0) {
+            const unsigned char* fmt = reader_span(r, pos + 8, 16);
+            if (!fmt) return 0;
+            
+            audio_format = read_le16(fmt);
+            num_channels = read_le16(fmt + 2);
+            sample_rate = read_le32(fmt + 4);
+            // 跳过字节率和块对齐
+            bits_per_sample = read_le16(fmt + 14);
+            found_fmt = 1;
+        } else if (memcmp(chunk, WAV_DATA_HEADER, 4) == 0 && found_fmt) {
             data_size = chunk_size;
-            break;
+            found_data = 1;
         }
         
-        // 跳过当前块
-        fseek(file, chunk_size, SEEK_CUR);
+        // 跳过当前块（块按偶数字节对齐）
+        pos += 8 + (long long)chunk_size + (chunk_size & 1);
     }
     
-    fclose(file);
+    // 只支持PCM格式
+    if (!found_fmt || audio_format != 1) return 0;
     
     if (!found_data || data_size == 0) {
         return 0;
@@ -197,22 +1127,41 @@ static int parse_wav_file(const char* filename, WAVInfo* info) {
     
     if (sample_rate > 0 && num_channels > 0 && bits_per_sample > 0) {
         unsigned int bytes_per_sample = bits_per_sample / 8;
+        if (bytes_per_sample == 0) return 0;
         unsigned long long total_samples = data_size / (bytes_per_sample * num_channels);
         info->duration = (double)total_samples / sample_rate;
+        AP_STAT_STRATEGY(AP_STRATEGY_HEADER);
         return 1;
     }
     
     return 0;
 }
 
-// OGG函数
-static int read_ogg_page_header(FILE* file, OGGPageHeader* header, long long* data_size) {
-    size_t bytes_read;
-    unsigned char header_data[27];
-    
-    bytes_read = fread(header_data, 1, 27, file);
-    if (bytes_read < 27) return 0;
+static int parse_wav_file(const char* filename, WAVInfo* info) {
+    BlockReader reader;
+    if (!reader_open_file(&reader, filename)) return 0;
     
+    int result = parse_wav(&reader, info);
+    reader_close(&reader);
+    return result;
+}
+
+// OGG函数
+// Ogg页CRC32 (多项式0x04C11DB7，不反射)，半字节查表
+static const unsigned int ogg_crc_table[16] = {
+    0x00000000, 0x04C11DB7, 0x09823B6E, 0x0D4326D9, 0x130476DC, 0x17C56B6B, 0x1A864DB2, 0x1E475005,
+    0x2608EDB8, 0x22C9F00F, 0x2F8AD6D6, 0x2B4BCB61, 0x350C9B64, 0x31CD86D3, 0x3C8EA00A, 0x384FBDBD
+};
+
+static unsigned int ogg_crc32(unsigned int crc, const unsigned char* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        crc = (crc << 4) ^ ogg_crc_table[(crc >> 28) ^ (data[i] >> 4)];
+        crc = (crc << 4) ^ ogg_crc_table[(crc >> 28) ^ (data[i] & 0x0F)];
+    }
+    return crc;
+}
+
+static int decode_ogg_page_header(const unsigned char* header_data, OGGPageHeader* header) {
     if (memcmp(header_data, OGG_PAGE_HEADER, 4) != 0) return 0;
     
     memcpy(header->capture_pattern, header_data, 4);
@@ -224,92 +1173,486 @@ static int read_ogg_page_header(FILE* file, OGGPageHeader* header, long long* da
         header->granule_position |= ((unsigned long long)header_data[6 + i]) << (i * 8);
     }
     
-    header->bitstream_serial = 0;
-    header->page_sequence = 0;
-    header->checksum = 0;
-    
-    for (int i = 0; i < 4; i++) {
-        header->bitstream_serial |= ((unsigned int)header_data[14 + i]) << (i * 8);
-        header->page_sequence |= ((unsigned int)header_data[18 + i]) << (i * 8);
-        header->checksum |= ((unsigned int)header_data[22 + i]) << (i * 8);
-    }
+    header->bitstream_serial = read_le32(header_data + 14);
+    header->page_sequence = read_le32(header_data + 18);
+    header->checksum = read_le32(header_data + 22);
     
     header->page_segments = header_data[26];
+    return 1;
+}
+
+// 解析offset处的页头和段表，*data_size为页数据长度
+static int read_ogg_page_header(BlockReader* r, long long offset, OGGPageHeader* header, long long* data_size) {
+    const unsigned char* header_data = reader_span(r, offset, OGG_PAGE_HEADER_SIZE);
+    if (!header_data) return 0;
     
-    unsigned char* segment_table = (unsigned char*)malloc(header->page_segments);
-    if (!segment_table) return 0;
+    if (!decode_ogg_page_header(header_data, header)) return 0;
     
-    bytes_read = fread(segment_table, 1, header->page_segments, file);
-    if (bytes_read < header->page_segments) {
-        free(segment_table);
-        return 0;
-    }
+    const unsigned char* segment_table = reader_span(r, offset + OGG_PAGE_HEADER_SIZE, header->page_segments);
+    if (!segment_table) return 0;
     
     *data_size = 0;
     for (int i = 0; i < header->page_segments; i++) {
         *data_size += segment_table[i];
     }
-    
-    free(segment_table);
+    AP_STAT_ADD(frames, 1);
     return 1;
 }
 
-static int find_first_audio_page(FILE* file, unsigned int* sample_rate) {
-    long original_pos = ftell(file);
-    fseek(file, 0, SEEK_SET);
+static long long ogg_page_size(const OGGPageHeader* header, long long data_size) {
+    return OGG_PAGE_HEADER_SIZE + header->page_segments + data_size;
+}
+
+// 校验内存中的一整页：版本、段表、数据都在缓冲区内且CRC正确，返回页总长度
+static long long check_ogg_page(const unsigned char* page, size_t avail, OGGPageHeader* header) {
+    if (avail < OGG_PAGE_HEADER_SIZE) return 0;
+    if (!decode_ogg_page_header(page, header) || header->version != 0) return 0;
+    AP_STAT_ADD(frames, 1);
+    
+    size_t header_size = OGG_PAGE_HEADER_SIZE + header->page_segments;
+    if (avail < header_size) return 0;
+    
+    size_t page_size = header_size;
+    for (int i = 0; i < header->page_segments; i++) {
+        page_size += page[OGG_PAGE_HEADER_SIZE + i];
+    }
+    if (avail < page_size) return 0;
+    
+    // CRC字段按0参与计算
+    static const unsigned char zero_crc[4] = {0, 0, 0, 0};
+    unsigned int crc = ogg_crc32(0, page, 22);
+    crc = ogg_crc32(crc, zero_crc, 4);
+    crc = ogg_crc32(crc, page + 26, page_size - 26);
+    if (crc != header->checksum) return 0;
+    
+    return (long long)page_size;
+}
+
+// 校验offset处的页，整页读入后检查CRC
+static long long check_ogg_page_at(BlockReader* r, long long offset, OGGPageHeader* header) {
+    long long data_size;
+    if (!read_ogg_page_header(r, offset, header, &data_size)) return 0;
+    
+    long long page_size = ogg_page_size(header, data_size);
+    const unsigned char* page = reader_span(r, offset, (size_t)page_size);
+    if (!page) return 0;
+    
+    return check_ogg_page(page, (size_t)page_size, header);
+}
+
+// 认出Vorbis/Opus的识别头，记下编码参数
+static int ogg_read_codec_header(const unsigned char* p, size_t len, unsigned int serial, OGGInfo* info) {
+    if (len >= 23 && memcmp(p, "\x01vorbis", 7) == 0) {
+        info->codec = AUDIO_CODEC_VORBIS;
+        info->channels = p[11];
+        info->sample_rate = read_le32(p + 12);
+        info->bitstream_serial = serial;
+        return 1;
+    }
+    if (len >= 19 && memcmp(p, "OpusHead", 8) == 0) {
+        // granule总按48kHz计，头里的输入采样率只是参考
+        info->codec = AUDIO_CODEC_OPUS;
+        info->channels = p[9];
+        info->pre_skip = read_le16(p + 10);
+        info->sample_rate = 48000;
+        info->bitstream_serial = serial;
+        return 1;
+    }
+    return 0;
+}
+
+static int ogg_link_has_serial(const OGGLink* link, unsigned int serial) {
+    if (link->serial_count < 0) return 1;
+    for (int i = 0; i < link->serial_count; i++) {
+        if (link->serials[i] == serial) return 1;
+    }
+    return 0;
+}
+
+static void ogg_link_add_serial(OGGLink* link, unsigned int serial) {
+    if (link->serial_count < 0 || ogg_link_has_serial(link, serial)) return;
+    if (link->serial_count == OGG_MAX_LINK_STREAMS) {
+        link->serial_count = -1;
+        return;
+    }
+    link->serials[link->serial_count++] = serial;
+}
+
+// 读begin处一节开头的BOS页组：记下各逻辑流的序列号，第一个Vorbis/Opus流作为本节的音频流
+// 编码头必须在前10页里；认出音频流后接着走完剩下的BOS页，data_start停在组后第一页
+static int read_ogg_link_head(BlockReader* r, long long begin, OGGLink* link) {
+    memset(link, 0, sizeof(OGGLink));
+    link->begin = begin;
+    link->info.file_size = r->size;
     
     OGGPageHeader header;
     long long data_size;
+    long long pos = begin;
     int found = 0;
     
-    for (int i = 0; i < 10; i++) {
-        if (!read_ogg_page_header(file, &header, &data_size)) break;
+    for (int i = 0; found || i < 10; i++) {
+        if (!read_ogg_page_header(r, pos, &header, &data_size)) break;
         
-        long current_pos = ftell(file);
-        unsigned char page_data[100];
-        size_t read_size = data_size < 100 ? (size_t)data_size : 100;
+        int bos = header.header_type & 2;
+        if (found && !bos) break;
+        if (bos) ogg_link_add_serial(link, header.bitstream_serial);
         
-        if (fread(page_data, 1, read_size, file) == read_size) {
-            if (memcmp(page_data, "\x01vorbis", 7) == 0 && read_size >= 23) {
-                *sample_rate = (unsigned int)page_data[12] | 
-                              ((unsigned int)page_data[13] << 8) |
-                              ((unsigned int)page_data[14] << 16) |
-                              ((unsigned int)page_data[15] << 24);
+        long long data_pos = pos + OGG_PAGE_HEADER_SIZE + header.page_segments;
+        if (!found) {
+            size_t read_size = data_size < 100 ? (size_t)data_size : 100;
+            const unsigned char* page_data = reader_span(r, data_pos, read_size);
+            if (page_data && ogg_read_codec_header(page_data, read_size, header.bitstream_serial, &link->info)) {
+                // 没打BOS标志的流也认
+                ogg_link_add_serial(link, header.bitstream_serial);
                 found = 1;
-                break;
             }
-            else if (memcmp(page_data, "OpusHead", 8) == 0 && read_size >= 12) {
-                *sample_rate = (unsigned int)page_data[8] | 
-                              ((unsigned int)page_data[9] << 8) |
-                              ((unsigned int)page_data[10] << 16) |
-                              ((unsigned int)page_data[11] << 24);
-                found = 1;
-                break;
+        }
+        
+        pos = data_pos + data_size;
+    }
+    
+    link->data_start = pos;
+    return found && link->info.sample_rate > 0;
+}
+
+// Opus包的时长（48kHz样本数），由TOC字节和帧数码得出（RFC 6716 3.1节），p至少要有2字节才能读code 3的帧数
+static int opus_packet_samples(const unsigned char* p, size_t len) {
+    static const int silk_samples[4] = { 480, 960, 1920, 2880 };
+    if (len == 0) return 0;
+    
+    int config = p[0] >> 3;
+    int frame_samples;
+    if (config < 12) frame_samples = silk_samples[config & 3];     // SILK：10/20/40/60ms
+    else if (config < 16) frame_samples = 480 << (config & 1);     // Hybrid：10/20ms
+    else frame_samples = 120 << (config & 3);                      // CELT：2.5/5/10/20ms
+    
+    switch (p[0] & 3) {
+        case 0:  return frame_samples;
+        case 3:  return len >= 2 ? (p[1] & 0x3F) * frame_samples : 0;
+        default: return 2 * frame_samples;
+    }
+}
+
+// 第一个音频页上结束的各Opus包的总时长；页的granule减去它就是流的起始granule（RFC 7845 4.3节）
+// 音频数据必须从新页开始，首页是续页时不可信，返回-1
+static long long opus_page_samples(BlockReader* r, long long page_pos, const OGGPageHeader* header) {
+    if (header->header_type & 1) return -1;
+    
+    unsigned char lacing[255];
+    const unsigned char* table = reader_span(r, page_pos + OGG_PAGE_HEADER_SIZE, header->page_segments);
+    if (!table) return -1;
+    memcpy(lacing, table, header->page_segments);
+    
+    long long packet_pos = page_pos + OGG_PAGE_HEADER_SIZE + header->page_segments;
+    long long packet_len = 0;
+    long long samples = 0;
+    for (int i = 0; i < header->page_segments; i++) {
+        packet_len += lacing[i];
+        if (lacing[i] == 255) continue;
+        
+        size_t toc_len = packet_len < 2 ? (size_t)packet_len : 2;
+        if (toc_len > 0) {
+            const unsigned char* toc = reader_span(r, packet_pos, toc_len);
+            if (!toc) return -1;
+            samples += opus_packet_samples(toc, toc_len);
+        }
+        packet_pos += packet_len;
+        packet_len = 0;
+    }
+    return samples;
+}
+
+// 首页granule小于包时长只可能是同时在末页做了结尾裁剪，起点仍是0
+static void ogg_set_start(OGGInfo* info, long long page_samples) {
+    long long granule = info->first_granule_position;
+    info->start_granule = page_samples >= 0 && granule > page_samples ? granule - page_samples : 0;
+}
+
+// 从begin顺序读页头（只跳过数据不读），找到音频流第一个带granule的页即停；Opus顺带推出起始granule
+static int find_first_granule(BlockReader* r, OGGInfo* info, long long begin, long long end, long long* page_end) {
+    OGGPageHeader header;
+    long long data_size;
+    long long pos = begin;
+    
+    while (pos < end && read_ogg_page_header(r, pos, &header, &data_size)) {
+        long long page_pos = pos;
+        pos += ogg_page_size(&header, data_size);
+        if (header.bitstream_serial == info->bitstream_serial &&
+            header.granule_position > 0 && header.granule_position != OGG_GRANULE_NONE) {
+            info->first_granule_position = (long long)header.granule_position;
+            if (info->codec == AUDIO_CODEC_OPUS) ogg_set_start(info, opus_page_samples(r, page_pos, &header));
+            if (page_end) *page_end = pos;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// 从end往前按小窗口找"OggS"，返回最后一个CRC正确、整页落在end之前的页的位置，找不到返回-1，读失败返回-2
+// serial为OGG_ANY_SERIAL时不限逻辑流，否则只认该流带granule的页
+// 最多往前找OGG_TAIL_MAX_WINDOW字节，再不行就交给整段遍历
+static long long find_last_ogg_page(BlockReader* r, long long end, long long serial, OGGPageHeader* found) {
+    long long limit = end - OGG_TAIL_MAX_WINDOW;
+    if (limit < 0) limit = 0;
+    
+    long long chunk_end = end;
+    while (chunk_end > limit) {
+        long long chunk_start = chunk_end - OGG_TAIL_WINDOW;
+        if (chunk_start < limit) chunk_start = limit;
+        
+        // 多取3字节，跨窗口边界的"OggS"也能找到
+        long long window_end = chunk_end + 3;
+        if (window_end > end) window_end = end;
+        size_t window_size = (size_t)(window_end - chunk_start);
+        
+        const unsigned char* window = reader_span(r, chunk_start, window_size);
+        if (!window) return -2;
+        
+        for (long long pos = chunk_end - 1; pos >= chunk_start; pos--) {
+            size_t at = (size_t)(pos - chunk_start);
+            if (window[at] != 'O' || at + 4 > window_size || memcmp(window + at, OGG_PAGE_HEADER, 4) != 0) {
+                continue;
+            }
+            
+            OGGPageHeader header;
+            long long page_size = check_ogg_page_at(r, pos, &header);
+            if (page_size > 0 && pos + page_size <= end &&
+                (serial == OGG_ANY_SERIAL ||
+                 (header.bitstream_serial == (unsigned int)serial &&
+                  header.granule_position > 0 && header.granule_position != OGG_GRANULE_NONE))) {
+                *found = header;
+                return pos;
+            }
+            
+            // 校验时可能换了块，重新取窗口
+            window = reader_span(r, chunk_start, window_size);
+            if (!window) return -2;
+        }
+        
+        chunk_end = chunk_start;
+    }
+    
+    return -1;
+}
+
+// 从offset往后找第一个CRC正确、起点在limit之前的页，找不到返回-1，读失败返回-2
+static long long find_next_ogg_page(BlockReader* r, long long offset, long long limit, OGGPageHeader* header) {
+    long long pos = offset;
+    while (pos < limit) {
+        if (pos + 4 > r->size) return -1;
+        
+        size_t avail;
+        const unsigned char* window = reader_window(r, pos, 4, &avail);
+        if (!window) return -2;
+        
+        long long scan_end = pos + (long long)avail - 3;
+        if (scan_end > limit) scan_end = limit;
+        long long at = pos;
+        while (at < scan_end && (window[at - pos] != 'O' || memcmp(window + (at - pos), OGG_PAGE_HEADER, 4) != 0)) {
+            at++;
+        }
+        if (at == scan_end) {
+            pos = scan_end;
+            continue;
+        }
+        
+        if (check_ogg_page_at(r, at, header) > 0) return at;
+        pos = at + 1;
+    }
+    return -1;
+}
+
+// 二分找本节的终点，I/O是文件长度的对数级：lo是本节内的页边界，boundary处的页不属于本节
+// 每次在中点之后找一页，属于本节就把lo推到它后面，否则它就是新的boundary；
+// 区间缩到一块以内后从lo逐页走到第一个不属于本节的页。返回下一节第一页的位置，读失败返回-1
+static long long bisect_ogg_link_end(BlockReader* r, const OGGLink* link, long long lo, long long boundary) {
+    OGGPageHeader header;
+    long long data_size;
+    long long hi = boundary;
+    
+    while (hi - lo > READER_BLOCK_SIZE) {
+        long long mid = lo + (hi - lo) / 2;
+        long long at = find_next_ogg_page(r, mid, hi, &header);
+        if (at == -2) return -1;
+        
+        if (at < 0) {
+            // 中点到hi之间没有页起点，前半段里的页都不越过hi
+            hi = mid;
+        } else if (ogg_link_has_serial(link, header.bitstream_serial)) {
+            if (!read_ogg_page_header(r, at, &header, &data_size)) return -1;
+            lo = at + ogg_page_size(&header, data_size);
+        } else {
+            boundary = at;
+            hi = at;
+        }
+    }
+    
+    long long pos = lo;
+    while (pos < boundary) {
+        if (!read_ogg_page_header(r, pos, &header, &data_size)) return -1;
+        if (!ogg_link_has_serial(link, header.bitstream_serial)) return pos;
+        pos += ogg_page_size(&header, data_size);
+    }
+    return boundary;
+}
+
+// 整段顺序遍历一节，尾部扫描失败时的兜底：BOS页组之后再遇到BOS页就是下一节的开始，返回本节终点
+static long long scan_ogg_link_forward(BlockReader* r, OGGLink* link) {
+    OGGInfo* info = &link->info;
+    OGGPageHeader header;
+    long long data_size;
+    long long pos = link->begin;
+    int first_granule_found = 0;
+    
+    info->first_granule_position = 0;
+    info->last_granule_position = 0;
+    info->start_granule = 0;
+    info->total_pages = 0;
+    
+    while (read_ogg_page_header(r, pos, &header, &data_size)) {
+        if ((header.header_type & 2) && pos >= link->data_start) break;
+        info->total_pages++;
+        
+        if (header.bitstream_serial == info->bitstream_serial &&
+            header.granule_position > 0 && header.granule_position != OGG_GRANULE_NONE) {
+            if (!first_granule_found) {
+                info->first_granule_position = (long long)header.granule_position;
+                if (info->codec == AUDIO_CODEC_OPUS) ogg_set_start(info, opus_page_samples(r, pos, &header));
+                first_granule_found = 1;
             }
+            info->last_granule_position = (long long)header.granule_position;
+        }
+        
+        pos += ogg_page_size(&header, data_size);
+    }
+    
+    return first_granule_found && info->last_granule_position > 0 ? pos : -1;
+}
+
+// 末页granule就是最后一个样本的位置：减去起始granule，Opus再减pre-skip（RFC 7845 4.5节）
+// Vorbis按从0开始算：要推出起始granule得先从setup头里解出各模式的块长，这里不做
+static int ogg_set_duration(OGGInfo* info) {
+    if (info->sample_rate == 0 || info->last_granule_position < info->first_granule_position) return 0;
+    
+    long long total_samples = info->last_granule_position - info->start_granule - info->pre_skip;
+    info->total_samples = total_samples > 0 ? total_samples : 0;
+    info->duration = (double)info->total_samples / info->sample_rate;
+    return 1;
+}
+
+// 把一节并进总数：编码参数取第一节，样本数按第一节的采样率折算
+static void ogg_add_link(OGGInfo* total, const OGGInfo* link) {
+    if (total->link_count == 0) {
+        long long file_size = total->file_size;
+        *total = *link;
+        total->file_size = file_size;
+        total->total_samples = 0;
+        total->total_pages = 0;
+    }
+    if (link->sample_rate == total->sample_rate) total->total_samples += link->total_samples;
+    else total->total_samples += link->total_samples * total->sample_rate / link->sample_rate;
+    total->total_pages += link->total_pages;
+    total->link_count++;
+    total->duration = (double)total->total_samples / total->sample_rate;
+}
+
+static void ogg_link_to_export(const OGGLink* link, long long end, AudioOggLink* out) {
+    memset(out, 0, sizeof(AudioOggLink));
+    out->offset = link->begin;
+    out->size = end - link->begin;
+    out->serial = link->info.bitstream_serial;
+    out->codec = link->info.codec;
+    out->sample_rate = link->info.sample_rate;
+    out->channels = link->info.channels;
+    out->stream_count = link->serial_count > 0 ? (unsigned int)link->serial_count : 0;
+    out->total_samples = (unsigned long long)link->info.total_samples;
+    out->leading_samples = link->info.pre_skip;
+    out->duration = link->info.duration;
+}
+
+// 逐节解析链式Ogg（电台录音、拼接的Opus等），每节内可以复用多个逻辑流，只按音频流的granule算时长
+// 先从文件尾找最后一页：它属于当前节，当前节就一直到文件尾（单节文件和从前一样只读头尾）；
+// 否则二分找出当前节的终点，在终点前往回找音频流的末页。找不到时退回整节顺序遍历
+// links非空时写入前max_links节的信息（每项link_size字节）；返回节数，失败返回0
+static int parse_ogg_chain(BlockReader* r, OGGInfo* info, AudioOggLink* links, int max_links, size_t link_size) {
+    memset(info, 0, sizeof(OGGInfo));
+    info->file_size = r->size;
+    
+    // 文件末页等读完第一节开头再找，单节文件的读盘顺序和以前一样是先头后尾
+    OGGPageHeader last;
+    long long last_pos = -3;
+    int scanned = 0;
+    long long pos = 0;
+    
+    while (pos < r->size) {
+        OGGLink link;
+        if (!read_ogg_link_head(r, pos, &link)) {
+            if (info->link_count == 0 || r->budget > 0) return 0;
+            break;
+        }
+        
+        long long end = -1;
+        long long first_end = 0;
+        int ok = find_first_granule(r, &link.info, pos, r->size, &first_end);
+        if (ok && last_pos == -3) last_pos = find_last_ogg_page(r, r->size, OGG_ANY_SERIAL, &last);
+        if (ok && last_pos >= link.data_start) {
+            if (ogg_link_has_serial(&link, last.bitstream_serial)) end = r->size;
+            else end = bisect_ogg_link_end(r, &link, link.data_start, last_pos);
+        }
+        OGGPageHeader header;
+        ok = ok && end >= first_end && find_last_ogg_page(r, end, link.info.bitstream_serial, &header) >= 0;
+        if (ok) link.info.last_granule_position = (long long)header.granule_position;
+        if (!ok) {
+            // 有读盘预算时不做整段遍历，交给调用方估算
+            if (r->budget > 0) return 0;
+            end = scan_ogg_link_forward(r, &link);
+            ok = end > pos;
+            scanned = 1;
+        }
+        if (!ok || !ogg_set_duration(&link.info)) {
+            if (info->link_count == 0 || r->budget > 0) return 0;
+            break;
         }
         
-        if (data_size > read_size) {
-            fseek(file, (long)(data_size - read_size), SEEK_CUR);
+        if (links && info->link_count < max_links) {
+            AudioOggLink exported;
+            ogg_link_to_export(&link, end, &exported);
+            memcpy((char*)links + (size_t)info->link_count * link_size, &exported,
+                   link_size < sizeof(AudioOggLink) ? link_size : sizeof(AudioOggLink));
         }
+        ogg_add_link(info, &link.info);
+        pos = end;
     }
     
-    fseek(file, original_pos, SEEK_SET);
-    return found;
+    if (info->link_count == 0) return 0;
+    AP_STAT_STRATEGY(scanned ? AP_STRATEGY_OGG_SCAN : AP_STRATEGY_OGG_TAIL);
+    return info->link_count;
+}
+
+static int parse_ogg(BlockReader* r, OGGInfo* info) {
+    return parse_ogg_chain(r, info, NULL, 0, 0) > 0;
+}
+
+static int parse_ogg_file(const char* filename, OGGInfo* info) {
+    BlockReader reader;
+    if (!reader_open_file(&reader, filename)) return 0;
+    
+    int result = parse_ogg(&reader, info);
+    reader_close(&reader);
+    return result;
 }
 
 // FLAC函数
-static int check_flac_signature(FILE* file) {
-    unsigned char signature[4];
-    size_t bytes_read = fread(signature, 1, 4, file);
-    if (bytes_read < 4) return 0;
-    return memcmp(signature, FLAC_SIGNATURE, 4) == 0;
+// 返回第一个元数据块的位置（签名之后），不是FLAC返回0
+static long long check_flac_signature(BlockReader* r) {
+    long long signature = find_signature(r, FLAC_SIGNATURE);
+    return signature < 0 ? 0 : signature + 4;
 }
 
-static void parse_streaminfo_block(FILE* file, FLACInfo* info, unsigned int block_length) {
+static void parse_streaminfo_block(const unsigned char* block_data, FLACInfo* info, unsigned int block_length) {
     if (block_length != 34) return;
     
-    unsigned char block_data[34];
-    if (fread(block_data, 1, 34, file) != 34) return;
+    info->max_block_size = ((unsigned int)block_data[2] << 8) | block_data[3];
     
     // 解析采样率 (20 bits, 位置 10-12 字节的高20位)
     unsigned long long sample_rate_channels_bps = 0;
@@ -335,17 +1678,17 @@ static void parse_streaminfo_block(FILE* file, FLACInfo* info, unsigned int bloc
     }
 }
 
-static int parse_flac_metadata(FILE* file, FLACInfo* info) {
+// 从pos处的第一个元数据块往后走。need_offset为0且STREAMINFO里有总样本数时读完它就停：只要时长的调用不用再走到音频起点，
+// audio_offset（比特率要用）因此留0；总样本数为0时要靠SEEKTABLE和末帧，照样走完全部块头
+static int parse_flac_metadata(BlockReader* r, FLACInfo* info, long long pos, int need_offset) {
     int last_block = 0;
     
     while (!last_block) {
-        unsigned char block_header[4];
-        if (fread(block_header, 1, 4, file) < 4) break;
+        const unsigned char* block_header = reader_span(r, pos, 4);
+        if (!block_header) break;
+        AP_STAT_ADD(frames, 1);
         
-        unsigned int block_info = 0;
-        for (int i = 0; i < 4; i++) {
-            block_info = (block_info << 8) | block_header[i];
-        }
+        unsigned int block_info = read_be32(block_header);
         
         int is_last = (block_info >> 31) & 0x01;
         int block_type = (block_info >> 24) & 0x7F;
@@ -354,70 +1697,314 @@ static int parse_flac_metadata(FILE* file, FLACInfo* info) {
         last_block = (is_last == 1);
         
         if (block_type == 0) {  // STREAMINFO块
-            parse_streaminfo_block(file, info, block_length);
-            break;  // 找到STREAMINFO后就可以返回了
-        } else {
-            fseek(file, block_length, SEEK_CUR);
+            const unsigned char* block_data = reader_span(r, pos + 4, block_length);
+            if (block_data) {
+                parse_streaminfo_block(block_data, info, block_length);
+            }
+            if (!need_offset && info->duration > 0) break;
+        } else if (block_type == 3 && info->total_samples == 0) {
+            // SEEKTABLE：只要最后一个有效点，占位点（样本号全1）都排在末尾
+            for (unsigned int i = block_length / 18; i > 0; i--) {
+                const unsigned char* point = reader_span(r, pos + 4 + (long long)(i - 1) * 18, 18);
+                if (!point) break;
+                
+                unsigned long long sample = ((unsigned long long)read_be32(point) << 32) | read_be32(point + 4);
+                unsigned long long offset = ((unsigned long long)read_be32(point + 8) << 32) | read_be32(point + 12);
+                if (sample == 0xFFFFFFFFFFFFFFFFULL) continue;
+                if ((offset >> 62) == 0) {
+                    info->seek_sample = sample;
+                    info->seek_offset = (long long)offset;  // 相对第一帧，走完元数据再换成文件偏移
+                }
+                break;
+            }
         }
+        
+        pos += 4 + (long long)block_length;
+        
+        // 只读块头，一直走到最后一个元数据块，得到音频数据起点
+        if (last_block) info->audio_offset = pos;
     }
+    if (info->seek_offset > 0) info->seek_offset += info->audio_offset;
     
+    if (info->duration > 0) AP_STAT_STRATEGY(AP_STRATEGY_HEADER);
     return info->duration > 0;
 }
 
-static int parse_flac_file(const char* filename, FLACInfo* info) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) return 0;
+static unsigned char flac_crc8(const unsigned char* data, size_t len) {
+    unsigned char crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) crc = (unsigned char)((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+    }
+    return crc;
+}
+
+// 解析帧头：同步码、保留位、UTF-8编码的帧号/样本号、CRC-8都要对，采样率/声道/位深和STREAMINFO一致
+static int parse_flac_frame_header(const unsigned char* p, size_t avail, const FLACInfo* info, FLACFrameHeader* frame) {
+    static const unsigned int rates[12] = { 0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100,
+                                            48000, 96000 };
+    static const unsigned int bits[8] = { 0, 8, 12, 0, 16, 20, 24, 32 };
+    if (avail < 6 || p[0] != 0xFF || (p[1] & 0xFE) != 0xF8) return 0;
     
-    memset(info, 0, sizeof(FLACInfo));
+    int block_code = p[2] >> 4;
+    int rate_code = p[2] & 0x0F;
+    int channel_code = p[3] >> 4;
+    int bits_code = (p[3] >> 1) & 0x07;
+    if (block_code == 0 || rate_code == 15 || channel_code > 10 || bits_code == 3 || (p[3] & 1)) return 0;
+    frame->variable = p[1] & 1;
+    
+    // 帧号最多6字节（31位），样本号最多7字节（36位）
+    unsigned long long number = p[4];
+    int extra = 0;
+    while (extra < 8 && (number & (0x80 >> extra))) extra++;
+    if (extra == 1 || extra > (frame->variable ? 7 : 6)) return 0;
+    if (extra > 0) {
+        number &= 0x7F >> extra;
+        extra--;
+    }
+    
+    size_t pos = 5;
+    if (pos + (size_t)extra > avail) return 0;
+    for (int i = 0; i < extra; i++, pos++) {
+        if ((p[pos] & 0xC0) != 0x80) return 0;
+        number = (number << 6) | (p[pos] & 0x3F);
+    }
+    frame->number = number;
+    
+    size_t tail = (block_code == 6) + (block_code == 7) * 2 + (rate_code == 12) + (rate_code >= 13) * 2;
+    if (pos + tail + 1 > avail) return 0;
+    if (block_code == 1) frame->block_size = 192;
+    else if (block_code <= 5) frame->block_size = 576u << (block_code - 2);
+    else if (block_code == 6) frame->block_size = p[pos++] + 1u;
+    else if (block_code == 7) {
+        frame->block_size = (((unsigned int)p[pos] << 8) | p[pos + 1]) + 1u;
+        pos += 2;
+    } else frame->block_size = 256u << (block_code - 8);
+    
+    unsigned int rate = rates[rate_code < 12 ? rate_code : 0];
+    if (rate_code == 12) {
+        rate = p[pos++] * 1000u;
+    } else if (rate_code >= 13) {
+        rate = ((unsigned int)p[pos] << 8) | p[pos + 1];
+        if (rate_code == 14) rate *= 10;
+        pos += 2;
+    }
+    
+    if (flac_crc8(p, pos) != p[pos]) return 0;
+    
+    unsigned int channels = channel_code < 8 ? (unsigned int)channel_code + 1 : 2;
+    return (rate == 0 || rate == info->sample_rate) && channels == info->channels &&
+           (bits[bits_code] == 0 || bits[bits_code] == info->bits_per_sample);
+}
+
+static unsigned long long flac_frame_first_sample(const FLACFrameHeader* frame, const FLACInfo* info) {
+    return frame->variable ? frame->number : frame->number * info->max_block_size;
+}
+
+// 总样本数由认出的末帧推出：末帧起始样本加它的块大小
+static void flac_set_last_frame(FLACInfo* info, const FLACFrameHeader* last) {
+    info->total_samples = flac_frame_first_sample(last, info) + last->block_size;
+    info->duration = (double)info->total_samples / info->sample_rate;
+}
+
+// b紧接在a之后：固定块大小时帧号连续，可变块大小时样本号首尾相接
+static int flac_frame_follows(const FLACFrameHeader* a, const FLACFrameHeader* b) {
+    if (a->variable != b->variable) return 0;
+    if (b->variable) return b->number == a->number + a->block_size;
+    return b->number == a->number + 1;
+}
+
+// 顺着位置认帧。音频数据里偶尔也有能过CRC-8的假帧头，所以先认一个可信的帧：和前一个候选帧号相接，
+// 或者正好是anchor处、起始样本为anchor_sample的帧；之后只认接得上的帧，最后接到的就是末帧
+typedef struct {
+    long long anchor;
+    unsigned long long anchor_sample;
+    FLACFrameHeader previous;
+    FLACFrameHeader last;
+    int have_previous;
+    int have_last;
+    int read_failed;                // 扫描途中读不到数据（I/O错误或预算用完），停在那里
+} FLACChain;
+
+typedef struct {
+    long long offset;
+    FLACFrameHeader header;
+} FLACCandidate;
+
+static void flac_chain_init(FLACChain* chain, long long anchor, unsigned long long anchor_sample) {
+    memset(chain, 0, sizeof(FLACChain));
+    chain->anchor = anchor;
+    chain->anchor_sample = anchor_sample;
+}
+
+static void flac_chain_add(FLACChain* chain, const FLACInfo* info, const FLACCandidate* candidate) {
+    const FLACFrameHeader* frame = &candidate->header;
+    if (chain->have_last) {
+        if (flac_frame_follows(&chain->last, frame)) chain->last = *frame;
+    } else if ((chain->have_previous && flac_frame_follows(&chain->previous, frame)) ||
+               (candidate->offset == chain->anchor && flac_frame_first_sample(frame, info) == chain->anchor_sample)) {
+        chain->last = *frame;
+        chain->have_last = 1;
+    }
+    chain->previous = *frame;
+    chain->have_previous = 1;
+}
+
+// 在[start, end)里顺着找帧头喂给chain；还没认出帧时把候选记进kept（最多max个，超出就放弃），
+// 往前扩窗口时这些候选接在新区间后面重放，不用重扫。返回记下的个数，超出返回-1；
+// 读失败时置chain->read_failed，返回已记下的个数
+static int flac_scan_frames(BlockReader* r, const FLACInfo* info, long long start, long long end, FLACChain* chain,
+                            FLACCandidate* kept, int max) {
+    int count = 0;
+    long long pos = start;
+    if (end > r->size) end = r->size;
+    
+    // 帧头从end之前开始就算，同步码的第二个字节可以落在end上
+    while (pos < end && pos < r->size - 1) {
+        size_t avail;
+        const unsigned char* window = reader_window(r, pos, 2, &avail);
+        if (!window) {
+            chain->read_failed = 1;
+            break;
+        }
+        if ((long long)avail > end + 1 - pos) avail = (size_t)(end + 1 - pos);
+        
+        size_t i = 0;
+        while (i + 1 < avail && (window[i] != 0xFF || (window[i + 1] & 0xFE) != 0xF8)) i++;
+        if (i + 1 >= avail) {
+            pos += (long long)avail - 1;
+            continue;
+        }
+        
+        FLACCandidate candidate;
+        candidate.offset = pos + (long long)i;
+        long long left = r->size - candidate.offset;
+        size_t head_len = left < FLAC_MAX_FRAME_HEADER ? (size_t)left : FLAC_MAX_FRAME_HEADER;
+        const unsigned char* head = reader_span(r, candidate.offset, head_len);
+        if (!head) {
+            chain->read_failed = 1;
+            break;
+        }
+        
+        if (parse_flac_frame_header(head, head_len, info, &candidate.header)) {
+            if (!chain->have_last && kept) {
+                if (count == max) return -1;
+                kept[count++] = candidate;
+            }
+            flac_chain_add(chain, info, &candidate);
+        }
+        pos = candidate.offset + 1;
+    }
+    return count;
+}
+
+// STREAMINFO里总样本数为0（流式编码、边录边写）时由最后一帧推出：末帧起始样本加它的块大小
+// SEEKTABLE最后一个点离文件尾不远就从这个已知的帧顺着扫到尾；否则从文件尾往回开窗口，窗口从window起倍增到max_window，
+// 每次只扫新扩出来的一段，之前扫过的区间里的候选帧头接在后面重放。
+// 认不出末帧时last（可为NULL）带回扫到的最后一个候选帧头，没有候选时offset为-1
+static int flac_tail_total(BlockReader* r, FLACInfo* info, long long window, long long max_window,
+                           FLACCandidate* last) {
+    if (last) last->offset = -1;
+    if (info->sample_rate == 0 || info->audio_offset <= 0 || info->audio_offset >= r->size) return 0;
+    if (info->max_block_size == 0 || max_window <= 0) return 0;
+    
+    FLACChain chain;
+    int found = 0;
+    if (info->seek_offset >= info->audio_offset && info->seek_offset < r->size &&
+        r->size - info->seek_offset <= max_window) {
+        flac_chain_init(&chain, info->seek_offset, info->seek_sample);
+        found = flac_scan_frames(r, info, info->seek_offset, r->size, &chain, NULL, 0) >= 0 && !chain.read_failed &&
+                chain.have_last;
+    }
     
-    if (!check_flac_signature(file)) {
-        fclose(file);
+    FLACCandidate kept[FLAC_TAIL_CANDIDATES];
+    FLACCandidate scanned[FLAC_TAIL_CANDIDATES];
+    int kept_count = 0;
+    int count = 0;
+    long long end = r->size;
+    for (; !found && end > info->audio_offset; window *= 2) {
+        if (window > max_window) window = max_window;
+        long long start = r->size - window;
+        if (start < info->audio_offset) start = info->audio_offset;
+        
+        flac_chain_init(&chain, info->audio_offset, 0);
+        count = flac_scan_frames(r, info, start, end, &chain, scanned, FLAC_TAIL_CANDIDATES);
+        if (count < 0) return 0;
+        if (chain.read_failed) break;
+        for (int i = 0; i < kept_count; i++) flac_chain_add(&chain, info, &kept[i]);
+        found = chain.have_last;
+        if (found || start == info->audio_offset || window >= max_window) break;
+        
+        // 新区间的候选排在前面
+        if (count + kept_count > FLAC_TAIL_CANDIDATES) return 0;
+        memmove(kept + count, kept, (size_t)kept_count * sizeof(FLACCandidate));
+        memcpy(kept, scanned, (size_t)count * sizeof(FLACCandidate));
+        kept_count += count;
+        end = start;
+        count = 0;
+    }
+    if (!found) {
+        if (last && kept_count > 0) *last = kept[kept_count - 1];
+        else if (last && count > 0) *last = scanned[count - 1];
         return 0;
     }
     
-    int result = parse_flac_metadata(file, info);
-    fclose(file);
+    flac_set_last_frame(info, &chain.last);
+    return 1;
+}
+
+static int parse_flac(BlockReader* r, FLACInfo* info, int need_offset) {
+    memset(info, 0, sizeof(FLACInfo));
+    
+    long long start = check_flac_signature(r);
+    if (start == 0) return 0;
+    if (parse_flac_metadata(r, info, start, need_offset)) return 1;
+    if (info->total_samples != 0 || !flac_tail_total(r, info, FLAC_TAIL_WINDOW, FLAC_TAIL_MAX_WINDOW, NULL)) return 0;
+    AP_STAT_STRATEGY(AP_STRATEGY_FLAC_TAIL);
+    return 1;
+}
+
+static int parse_flac_file(const char* filename, FLACInfo* info) {
+    BlockReader reader;
+    if (!reader_open_file(&reader, filename)) return 0;
+    
+    int result = parse_flac(&reader, info, 0);
+    reader_close(&reader);
     return result;
 }
 
 // MP3函数 - 优化版本
-static int get_mp3_bitrate(int version, int layer, int index) {
-    // MP3比特率表 (单位: kbps)
-    int bitrate_table[2][3][16] = {
-        { // MPEG Version 1
-            {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0}, // Layer 1
-            {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},    // Layer 2
-            {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0}      // Layer 3
-        },
-        { // MPEG Version 2 & 2.5
-            {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0}, // Layer 1
-            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},      // Layer 2
-            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0}       // Layer 3
-        }
-    };
-    
-    int version_key = (version == 1) ? 0 : 1;
-    int layer_key;
-    
-    if (layer == 1) layer_key = 0;
-    else if (layer == 2) layer_key = 1;
-    else if (layer == 3) layer_key = 2;
-    else return 0;
-    
-    if (index >= 0 && index < 16) {
-        return bitrate_table[version_key][layer_key][index] * 1000; // 转换为bps
+// MP3比特率表 (单位: kbps)
+static const unsigned short mp3_bitrate_table[2][3][16] = {
+    { // MPEG Version 1
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0}, // Layer 1
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0},    // Layer 2
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0}      // Layer 3
+    },
+    { // MPEG Version 2 & 2.5
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0}, // Layer 1
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},      // Layer 2
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0}       // Layer 3
     }
-    return 0;
+};
+
+// MP3采样率表
+static const int mp3_sample_rate_table[3][4] = {
+    {44100, 48000, 32000, 0},  // MPEG 1
+    {22050, 24000, 16000, 0},  // MPEG 2
+    {11025, 12000, 8000, 0}    // MPEG 2.5
+};
+
+// 帧头里的版本位/层位直接查表：版本 00=2.5 01=保留 10=2 11=1，层 00=保留 01=III 10=II 11=I
+static const double mp3_version_table[4] = {2.5, 0.0, 2.0, 1.0};
+static const int mp3_layer_table[4] = {0, 3, 2, 1};
+
+static int get_mp3_bitrate(int version, int layer, int index) {
+    if (layer < 1 || layer > 3 || index < 0 || index >= 16) return 0;
+    return mp3_bitrate_table[version == 1 ? 0 : 1][layer - 1][index] * 1000; // 转换为bps
 }
 
 static int get_mp3_sample_rate(double version, int index) {
-    // MP3采样率表
-    int sample_rate_table[3][4] = {
-        {44100, 48000, 32000, 0},  // MPEG 1
-        {22050, 24000, 16000, 0},   // MPEG 2
-        {11025, 12000, 8000, 0}     // MPEG 2.5
-    };
-    
     int version_key;
     if (version == 1.0) version_key = 0;
     else if (version == 2.0) version_key = 1;
@@ -425,16 +2012,18 @@ static int get_mp3_sample_rate(double version, int index) {
     else return 0;
     
     if (index >= 0 && index < 4) {
-        return sample_rate_table[version_key][index];
+        return mp3_sample_rate_table[version_key][index];
     }
     return 0;
 }
 
-static int get_mp3_frame_size(int layer, int bitrate, int sample_rate, int padding) {
+static int get_mp3_frame_size(double version, int layer, int bitrate, int sample_rate, int padding) {
     if (sample_rate == 0) return 0;
     
     if (layer == 1) { // Layer I
         return (12 * bitrate / sample_rate + padding) * 4;
+    } else if (layer == 3 && version != 1.0) { // MPEG 2/2.5 Layer III，每帧576个样本
+        return 72 * bitrate / sample_rate + padding;
     } else { // Layer II & III
         return 144 * bitrate / sample_rate + padding;
     }
@@ -449,19 +2038,13 @@ static int parse_mp3_header(unsigned char* header_bytes, MP3FrameHeader* header)
     // 检查同步字
     if ((header_val & 0xFFE00000) != 0xFFE00000) return 0;
     
-    // 提取MPEG版本
+    // 提取MPEG版本和层
     int version_bits = (header_val >> 19) & 0x3;
-    if (version_bits == 0) header->mpeg_version = 2.5;
-    else if (version_bits == 2) header->mpeg_version = 2.0;
-    else if (version_bits == 3) header->mpeg_version = 1.0;
-    else return 0;
-    
-    // 提取层
     int layer_bits = (header_val >> 17) & 0x3;
-    if (layer_bits == 1) header->layer = 3;
-    else if (layer_bits == 2) header->layer = 2;
-    else if (layer_bits == 3) header->layer = 1;
-    else return 0;
+    if (version_bits == 1 || layer_bits == 0) return 0;
+    
+    header->mpeg_version = mp3_version_table[version_bits];
+    header->layer = mp3_layer_table[layer_bits];
     
     // 保护位
     header->protection = (header_val >> 16) & 0x1;
@@ -479,317 +2062,4223 @@ static int parse_mp3_header(unsigned char* header_bytes, MP3FrameHeader* header)
     // 填充位
     header->padding = (header_val >> 9) & 0x1;
     
+    // 声道模式
+    header->channel_mode = (header_val >> 6) & 0x3;
+    
     // 计算帧大小
-    header->frame_size = get_mp3_frame_size(header->layer, header->bitrate, 
+    header->frame_size = get_mp3_frame_size(header->mpeg_version, header->layer, header->bitrate, 
                                           header->sample_rate, header->padding);
     
     return header->frame_size > 0;
 }
 
-static int skip_id3v2_tag(FILE* file) {
-    long original_pos = ftell(file);
-    unsigned char header[10];
-    
-    if (fread(header, 1, 10, file) != 10) {
-        fseek(file, original_pos, SEEK_SET);
-        return 0;
+// 帧同步字搜索：0xFF后跟高3位全1的字节
+// x86上用SSE2/AVX2一次比较32/64字节，运行时检测CPU选择实现，其他平台走标量版本
+static long long scan_sync_scalar(const unsigned char* p, size_t n) {
+    for (size_t i = 0; i + 1 < n; i++) {
+        if (p[i] == 0xFF && (p[i + 1] & 0xE0) == 0xE0) return (long long)i;
     }
+    return -1;
+}
+
+#if defined(__x86_64__) || defined(_M_X64) || \
+    ((defined(__i386__) || defined(_M_IX86)) && (defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#define AP_HAVE_SSE2 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AP_TARGET_AVX2
+#define AP_CTZ(x) ((int)_tzcnt_u32(x))
+#else
+#define AP_TARGET_AVX2 __attribute__((target("avx2")))
+#define AP_CTZ(x) __builtin_ctz(x)
+#endif
+
+static long long scan_sync_sse2(const unsigned char* p, size_t n) {
+    const __m128i ff = _mm_set1_epi8((char)0xFF);
+    const __m128i e0 = _mm_set1_epi8((char)0xE0);
+    size_t i = 0;
     
-    if (memcmp(header, "ID3", 3) == 0) {
-        // 计算ID3v2标签大小
-        int size = 0;
-        for (int i = 6; i < 10; i++) {
-            size = size * 128 + (header[i] & 0x7F);
-        }
-        fseek(file, size, SEEK_CUR);  // 跳过标签内容
-        return 1;
-    } else {
-        fseek(file, original_pos, SEEK_SET);
-        return 0;
+    // 每轮32字节；第二个加载错开1字节，对应同步字的第二个字节
+    for (; i + 33 <= n; i += 32) {
+        __m128i a0 = _mm_loadu_si128((const __m128i*)(p + i));
+        __m128i b0 = _mm_loadu_si128((const __m128i*)(p + i + 1));
+        __m128i a1 = _mm_loadu_si128((const __m128i*)(p + i + 16));
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(p + i + 17));
+        __m128i m0 = _mm_and_si128(_mm_cmpeq_epi8(a0, ff), _mm_cmpeq_epi8(_mm_and_si128(b0, e0), e0));
+        __m128i m1 = _mm_and_si128(_mm_cmpeq_epi8(a1, ff), _mm_cmpeq_epi8(_mm_and_si128(b1, e0), e0));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(m0) | ((unsigned int)_mm_movemask_epi8(m1) << 16);
+        if (mask) return (long long)(i + AP_CTZ(mask));
     }
+    
+    long long tail = scan_sync_scalar(p + i, n - i);
+    return tail < 0 ? -1 : (long long)i + tail;
 }
 
-static int skip_xing_header(FILE* file, int frame_size) {
-    long original_pos = ftell(file);
-    unsigned char header[12];
+AP_TARGET_AVX2
+static long long scan_sync_avx2(const unsigned char* p, size_t n) {
+    const __m256i ff = _mm256_set1_epi8((char)0xFF);
+    const __m256i e0 = _mm256_set1_epi8((char)0xE0);
+    size_t i = 0;
     
-    if (fread(header, 1, 12, file) != 12) {
-        fseek(file, original_pos, SEEK_SET);
-        return 0;
+    // 每轮64字节
+    for (; i + 65 <= n; i += 64) {
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)(p + i));
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)(p + i + 1));
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)(p + i + 32));
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(p + i + 33));
+        __m256i m0 = _mm256_and_si256(_mm256_cmpeq_epi8(a0, ff), _mm256_cmpeq_epi8(_mm256_and_si256(b0, e0), e0));
+        __m256i m1 = _mm256_and_si256(_mm256_cmpeq_epi8(a1, ff), _mm256_cmpeq_epi8(_mm256_and_si256(b1, e0), e0));
+        unsigned int mask0 = (unsigned int)_mm256_movemask_epi8(m0);
+        unsigned int mask1 = (unsigned int)_mm256_movemask_epi8(m1);
+        if (mask0) return (long long)(i + AP_CTZ(mask0));
+        if (mask1) return (long long)(i + 32 + AP_CTZ(mask1));
     }
     
-    // 检查Xing/VBRI头部
-    if (memcmp(header, "Xing", 4) == 0 || memcmp(header, "Info", 4) == 0) {
-        // 跳过Xing头部剩余部分
-        fseek(file, frame_size - 12 - 4, SEEK_CUR);
-        return 1;
-    } else if (memcmp(header, "VBRI", 4) == 0) {
-        // 跳过VBRI头部
-        fseek(file, frame_size - 12 - 4, SEEK_CUR);
-        return 1;
+    long long tail = scan_sync_sse2(p + i, n - i);
+    return tail < 0 ? -1 : (long long)i + tail;
+}
+
+static int cpu_has_avx2(void) {
+#ifdef _MSC_VER
+    // 结果只算一次；并发首次调用算出的值相同，无害
+    static volatile int cached = -1;
+    if (cached < 0) {
+        int regs[4];
+        int has = 0;
+        __cpuid(regs, 1);
+        if ((regs[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6) {  // OSXSAVE且系统保存YMM
+            __cpuidex(regs, 7, 0);
+            has = (regs[1] & (1 << 5)) != 0;
+        }
+        cached = has;
     }
-    
-    fseek(file, original_pos, SEEK_SET);
-    return 0;
+    return cached;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
 }
 
-static int get_mp3_duration_optimized(const char* filename) {
-    FILE* file = fopen(filename, "rb");
-    if (!file) return 0;
+static long long scan_sync(const unsigned char* p, size_t n) {
+    return cpu_has_avx2() ? scan_sync_avx2(p, n) : scan_sync_sse2(p, n);
+}
+#else
+static long long scan_sync(const unsigned char* p, size_t n) {
+    return scan_sync_scalar(p, n);
+}
+#endif
+
+// 从pos开始在缓冲数据里找下一个帧同步字，找不到返回-1
+static long long find_mp3_sync(BlockReader* r, long long pos, long long end) {
+    while (pos < end - 1) {
+        size_t avail;
+        const unsigned char* p = reader_window(r, pos, 2, &avail);
+        if (!p) return -1;
+        
+        if ((long long)avail > end - pos) avail = (size_t)(end - pos);
+        long long found = scan_sync(p, avail);
+        if (found >= 0) return pos + found;
+        pos += (long long)avail - 1;
+    }
+    return -1;
+}
+
+static int get_mp3_samples_per_frame(const MP3FrameHeader* header) {
+    if (header->layer == 1) return 384;
+    if (header->layer == 2 || header->mpeg_version == 1.0) return 1152;
+    return 576;  // MPEG 2, 2.5 Layer III
+}
+
+// LAME扩展紧跟在Xing字段之后，编码器延迟和填充各12位
+static void parse_lame_extension(const unsigned char* lame, size_t avail, MP3VBRHeader* vbr) {
+    if (avail < 36) return;
+    if (memcmp(lame, "LAME", 4) != 0 && memcmp(lame, "Lavf", 4) != 0 &&
+        memcmp(lame, "Lavc", 4) != 0) {
+        return;
+    }
     
-    // 跳过ID3v2标签
-    skip_id3v2_tag(file);
+    vbr->has_lame = 1;
+    vbr->encoder_delay = (lame[21] << 4) | (lame[22] >> 4);
+    vbr->encoder_padding = ((lame[22] & 0x0F) << 8) | lame[23];
+    vbr->music_length = read_be32(lame + 28);
+}
+
+// 解析第一帧中的Xing/Info/VBRI头部
+static int read_vbr_header(BlockReader* r, long long frame_pos, const MP3FrameHeader* header, MP3VBRHeader* vbr) {
+    memset(vbr, 0, sizeof(MP3VBRHeader));
     
-    // 获取文件大小
-    fseek(file, 0, SEEK_END);
-    long file_size = ftell(file);
-    fseek(file, 0, SEEK_SET);
+    size_t got = (size_t)header->frame_size;
+    if (frame_pos + (long long)got > r->size) got = (size_t)(r->size - frame_pos);
     
-    if (file_size <= 0) {
-        fclose(file);
-        return 0;
+    const unsigned char* frame = reader_span(r, frame_pos, got);
+    if (!frame) return 0;
+    
+    // Xing/Info位于边信息之后，偏移取决于版本和声道
+    size_t xing_offset;
+    if (header->mpeg_version == 1.0) {
+        xing_offset = 4 + (header->channel_mode == 3 ? 17 : 32);
+    } else {
+        xing_offset = 4 + (header->channel_mode == 3 ? 9 : 17);
+    }
+    
+    if (got >= xing_offset + 8 &&
+        (memcmp(frame + xing_offset, "Xing", 4) == 0 || memcmp(frame + xing_offset, "Info", 4) == 0)) {
+        vbr->type = (frame[xing_offset] == 'X') ? MP3_VBR_XING : MP3_VBR_INFO;
+        
+        unsigned int flags = read_be32(frame + xing_offset + 4);
+        size_t pos = xing_offset + 8;
+        
+        if (flags & 0x1) {
+            if (got < pos + 4) return 1;
+            vbr->frames = read_be32(frame + pos);
+            pos += 4;
+        }
+        if (flags & 0x2) {
+            if (got < pos + 4) return 1;
+            vbr->bytes = read_be32(frame + pos);
+            pos += 4;
+        }
+        if (flags & 0x4) {
+            if (got < pos + 100) return 1;
+            memcpy(vbr->toc, frame + pos, 100);
+            vbr->has_toc = 1;
+            pos += 100;
+        }
+        if (flags & 0x8) {
+            pos += 4;  // 质量指示
+        }
+        
+        if (got > pos) {
+            parse_lame_extension(frame + pos, got - pos, vbr);
+        }
+        if (vbr->bytes == 0 && vbr->music_length > (unsigned int)header->frame_size) {
+            vbr->bytes = vbr->music_length - (unsigned int)header->frame_size;
+        }
+        return 1;
+    }
+    
+    // VBRI固定在帧头后32字节
+    if (got >= 4 + 32 + 18 && memcmp(frame + 36, "VBRI", 4) == 0) {
+        vbr->type = MP3_VBR_VBRI;
+        vbr->bytes = read_be32(frame + 36 + 10);
+        vbr->frames = read_be32(frame + 36 + 14);
+        return 1;
+    }
+    
+    return 0;
+}
+
+// 由编码出的样本数扣掉LAME头给的编码器延迟和填充，得到可播放的样本数（与无缝播放的解码器一致）
+// 扣完不剩说明头部不可信，就不扣
+static void mp3_set_total(MP3Info* info, long long coded_samples) {
+    long long trimmed = (long long)info->leading_samples + info->trailing_samples;
+    if (trimmed >= coded_samples) {
+        info->leading_samples = 0;
+        info->trailing_samples = 0;
+        trimmed = 0;
+    }
+    info->total_samples = coded_samples - trimmed;
+    info->duration = (double)info->total_samples / info->sample_rate;
+}
+
+static void mp3_set_gapless(MP3Info* info, const MP3VBRHeader* vbr) {
+    if (!vbr->has_lame) return;
+    info->leading_samples = vbr->encoder_delay;
+    info->trailing_samples = vbr->encoder_padding;
+}
+
+// Xing/Info/VBRI头里有帧数时直接得出全部信息
+static int mp3_info_from_vbr(const MP3FrameHeader* header, const MP3VBRHeader* vbr, MP3Info* info) {
+    int samples_per_frame = get_mp3_samples_per_frame(header);
+    
+    info->sample_rate = header->sample_rate;
+    info->layer = header->layer;
+    info->channels = header->channel_mode == 3 ? 1 : 2;
+    info->is_vbr = (vbr->type != MP3_VBR_INFO);
+    mp3_set_gapless(info, vbr);
+    mp3_set_total(info, (long long)vbr->frames * samples_per_frame);
+    if (vbr->bytes > 0) {
+        info->bitrate = (int)(vbr->bytes * 8.0 / info->duration);
+    } else {
+        info->bitrate = header->bitrate;
     }
+    return info->duration > 0;
+}
+
+static int parse_mp3(BlockReader* r, MP3Info* info) {
+    memset(info, 0, sizeof(MP3Info));
+    
+    long long file_size = r->size;
+    if (file_size <= 0) return 0;
+    
+    // 跳过ID3v2标签
+    long long pos = skip_id3v2_tag(r);
     
-    unsigned char buffer[4];
     int total_frames = 0;
     long long total_samples = 0;
+    long long audio_bytes = 0;
+    long long first_frame_pos = 0;
     int first_valid_frame = 1;
     int sample_rate = 0;
     int is_vbr = 0;
     int first_bitrate = 0;
-    int different_bitrates = 0;
+    int strategy = AP_STRATEGY_FULL_WALK;
     
     // 采样多个帧来检测VBR
-    while (ftell(file) < file_size - 4) {
-        long current_pos = ftell(file);
-        
-        if (fread(buffer, 1, 4, file) != 4) break;
+    while (pos < file_size - 4) {
+        const unsigned char* buffer = reader_span(r, pos, 4);
+        if (!buffer) break;
         
         MP3FrameHeader header;
-        if (parse_mp3_header(buffer, &header)) {
+        if (parse_mp3_header((unsigned char*)buffer, &header)) {
+            int samples_per_frame = get_mp3_samples_per_frame(&header);
+            
+            // 第一帧可能是Xing/Info/VBRI信息帧，有帧数就直接算出时长
+            if (first_valid_frame) {
+                MP3VBRHeader vbr;
+                if (read_vbr_header(r, pos, &header, &vbr)) {
+                    if (vbr.frames > 0) {
+                        AP_STAT_STRATEGY(AP_STRATEGY_XING);
+                        return mp3_info_from_vbr(&header, &vbr, info);
+                    }
+                    // 没有帧数字段，信息帧本身不含音频，跳过后照常扫描
+                    mp3_set_gapless(info, &vbr);
+                    pos += header.frame_size;
+                    continue;
+                }
+            }
+            
             total_frames++;
+            audio_bytes += header.frame_size;
+            AP_STAT_ADD(frames, 1);
             
-            // 记录第一帧的采样率
+            // 记录第一帧的位置和采样率
             if (first_valid_frame) {
+                first_frame_pos = pos;
                 sample_rate = header.sample_rate;
                 first_bitrate = header.bitrate;
+                info->layer = header.layer;
+                info->channels = header.channel_mode == 3 ? 1 : 2;
                 first_valid_frame = 0;
             } else {
                 // 检查比特率是否变化
                 if (header.bitrate != first_bitrate) {
-                    different_bitrates = 1;
                     is_vbr = 1;
                 }
             }
             
-            // 跳过Xing/VBRI头部（VBR文件）
-            if (total_frames == 1) {
-                skip_xing_header(file, header.frame_size);
-            }
-            
-            // 计算样本数
-            int samples_per_frame;
-            if (header.layer == 1) {
-                samples_per_frame = 384;
-            } else if (header.mpeg_version == 1.0) { // MPEG 1
-                samples_per_frame = 1152;
-            } else { // MPEG 2, 2.5
-                samples_per_frame = 576;
-            }
-            
             total_samples += samples_per_frame;
             
-            // 跳过当前帧的剩余部分
-            if (header.frame_size > 4) {
-                fseek(file, current_pos + header.frame_size, SEEK_SET);
-            }
+            // 跳到下一帧
+            pos += header.frame_size;
             
             // 采样足够的帧用于分析
             if (total_frames >= 10 && !is_vbr) {
-                // 对于CBR文件，我们可以估算总帧数
+                // 对于CBR文件，按音频区长度（去掉前面的ID3v2/垃圾数据和末尾的ID3v1）除以平均帧长估算总帧数
                 if (sample_rate > 0 && first_bitrate > 0) {
-                    double avg_frame_size = (double)header.frame_size;
-                    double estimated_total_frames = file_size / avg_frame_size;
-                    total_samples = (long long)(estimated_total_frames * samples_per_frame);
+                    long long audio_end = file_size;
+                    const unsigned char* tag = audio_end - 128 >= pos ? reader_span(r, audio_end - 128, 3) : NULL;
+                    if (tag && memcmp(tag, "TAG", 3) == 0) audio_end -= 128;
+                    
+                    double avg_frame_size = (double)audio_bytes / total_frames;
+                    long long estimated_total_frames = (long long)((audio_end - first_frame_pos) / avg_frame_size + 0.5);
+                    total_samples = estimated_total_frames * samples_per_frame;
+                    info->estimated = 1;
+                    strategy = AP_STRATEGY_CBR_ESTIMATE;
                 }
                 break;
             }
         } else {
-            // 如果不是有效的帧头，向前移动1字节继续搜索
-            fseek(file, current_pos + 1, SEEK_SET);
+            // 不是有效的帧头，在缓冲数据里找下一个同步字
+            long long lost = pos;
+            pos = find_mp3_sync(r, pos + 1, file_size);
+            if (pos < 0) break;
+            AP_STAT_ADD(resync_bytes, pos - lost);
         }
     }
     
-    fclose(file);
-    
     // 计算时长
     if (sample_rate > 0 && total_samples > 0) {
-        return (int)(total_samples / sample_rate);
+        info->sample_rate = sample_rate;
+        info->is_vbr = is_vbr;
+        mp3_set_total(info, total_samples);
+        info->bitrate = is_vbr ? (int)(audio_bytes * 8.0 / info->duration) : first_bitrate;
+        AP_STAT_STRATEGY(strategy);
+        return 1;
     }
     
     return 0;
 }
 
-// 统一的音频解析函数
-int get_audio_duration(const char* filename) {
-    if (!filename) return 0;
+static int parse_mp3_file(const char* filename, MP3Info* info) {
+    BlockReader reader;
+    if (!reader_open_file(&reader, filename)) return 0;
+    
+    int result = parse_mp3(&reader, info);
+    reader_close(&reader);
+    return result;
+}
+
+static int get_mp3_duration_optimized(const char* filename) {
+    MP3Info info;
+    if (parse_mp3_file(filename, &info)) {
+        return (int)info.duration;
+    }
+    return 0;
+}
+
+// 格式识别：按内容判断，扩展名只作提示
+#define AUDIO_FORMAT_UNKNOWN 0
+#define AUDIO_FORMAT_WAV     1
+#define AUDIO_FORMAT_FLAC    2
+#define AUDIO_FORMAT_OGG     3
+#define AUDIO_FORMAT_MP3     4
+
+#define SNIFF_SIZE 4096     // 嗅探时在头部这么多字节内找MPEG同步
+
+static int format_from_extension(const char* filename) {
+    const char* ext = filename ? strrchr(filename, '.') : NULL;
+    if (!ext) return AUDIO_FORMAT_UNKNOWN;
+    
+    if (strcasecmp(ext, ".mp3") == 0 || strcasecmp(ext, ".mp2") == 0 ||
+        strcasecmp(ext, ".mpga") == 0) {
+        return AUDIO_FORMAT_MP3;
+    }
+    if (strcasecmp(ext, ".flac") == 0 || strcasecmp(ext, ".fla") == 0) {
+        return AUDIO_FORMAT_FLAC;
+    }
+    if (strcasecmp(ext, ".ogg") == 0 || strcasecmp(ext, ".oga") == 0 ||
+        strcasecmp(ext, ".opus") == 0 || strcasecmp(ext, ".ogx") == 0) {
+        return AUDIO_FORMAT_OGG;
+    }
+    if (strcasecmp(ext, ".wav") == 0 || strcasecmp(ext, ".wave") == 0) {
+        return AUDIO_FORMAT_WAV;
+    }
+    return AUDIO_FORMAT_UNKNOWN;
+}
+
+// pos处是一个MPEG帧，且紧跟着的下一帧参数一致
+static int check_mp3_frames_at(BlockReader* r, long long pos) {
+    const unsigned char* p = reader_span(r, pos, 4);
+    MP3FrameHeader first, second;
+    if (!p || !parse_mp3_header((unsigned char*)p, &first)) return 0;
+    
+    long long next = pos + first.frame_size;
+    if (next + 4 > r->size) return next <= r->size;  // 只有一帧的短数据
     
-    // 首先检查文件扩展名来确定类型
-    const char* ext = strrchr(filename, '.');
-    if (!ext) return 0;
+    p = reader_span(r, next, 4);
+    if (!p || !parse_mp3_header((unsigned char*)p, &second)) return 0;
     
-    // 尝试MP3格式
-    if (strcasecmp(ext, ".mp3") == 0) {
-        return get_mp3_duration_optimized(filename);
+    return first.mpeg_version == second.mpeg_version && first.layer == second.layer &&
+           first.sample_rate == second.sample_rate;
+}
+
+// start之后若干字节内有两个连续的合法帧，视为MP3
+static int sniff_mp3_frames(BlockReader* r, long long start) {
+    long long end = r->size - start < SNIFF_SIZE ? r->size : start + SNIFF_SIZE;
+    long long pos = find_mp3_sync(r, start, end);
+    while (pos >= 0) {
+        if (check_mp3_frames_at(r, pos)) return 1;
+        pos = find_mp3_sync(r, pos + 1, end);
     }
-    // 尝试FLAC格式
-    else if (strcasecmp(ext, ".flac") == 0) {
-        FLACInfo info;
-        if (parse_flac_file(filename, &info)) {
-            return (int)info.duration;
+    return 0;
+}
+
+// 只看头部一块数据，所有判断都落在同一个已缓存的块上，随后的解析器不会重读头部；
+// 只有ID3v2标签之后的内容可能要多读一次
+static int sniff_audio_format(BlockReader* r, int hint) {
+    const unsigned char* head = reader_span(r, 0, 12);
+    if (head) {
+        if (memcmp(head, WAV_RIFF_HEADER, 4) == 0 && memcmp(head + 8, WAV_WAVE_HEADER, 4) == 0) {
+            return AUDIO_FORMAT_WAV;
         }
     }
-    // 尝试OGG格式
-    else if (strcasecmp(ext, ".ogg") == 0) {
-        FILE* file = fopen(filename, "rb");
-        if (!file) return 0;
+    
+    head = reader_span(r, 0, 4);
+    if (!head) return AUDIO_FORMAT_UNKNOWN;
+    
+    if (memcmp(head, FLAC_SIGNATURE, 4) == 0) return AUDIO_FORMAT_FLAC;
+    if (memcmp(head, OGG_PAGE_HEADER, 4) == 0) return AUDIO_FORMAT_OGG;
+    
+    // ID3v2标签后面一般是MPEG帧，也有打在FLAC/WAV前面的，要看标签之后是什么。
+    // 扩展名也说是MP3时只看已在内存里的部分，带大封面的MP3不为此多读一次盘
+    long long audio_start = skip_id3v2_tag(r);
+    if (audio_start > 0) {
+        if (hint == AUDIO_FORMAT_MP3 && !reader_cached(r, audio_start, 12)) return AUDIO_FORMAT_MP3;
         
-        unsigned int sample_rate = 0;
-        if (!find_first_audio_page(file, &sample_rate)) {
-            fclose(file);
-            return 0;
+        // 标签之后读不到（推式解析只拿开头一段来嗅探）时维持原来的判断，按MP3
+        const unsigned char* p = reader_span(r, audio_start, 12);
+        if (!p) return AUDIO_FORMAT_MP3;
+        if (memcmp(p, FLAC_SIGNATURE, 4) == 0) return AUDIO_FORMAT_FLAC;
+        if (memcmp(p, WAV_RIFF_HEADER, 4) == 0 && memcmp(p + 8, WAV_WAVE_HEADER, 4) == 0) {
+            return AUDIO_FORMAT_WAV;
         }
+        if (hint == AUDIO_FORMAT_MP3 || sniff_mp3_frames(r, audio_start)) return AUDIO_FORMAT_MP3;
         
-        if (sample_rate == 0) {
-            fclose(file);
-            return 0;
+        // 标签后面看不出来就按扩展名；没有扩展名时仍当MP3，ID3v2标签绝大多数打在MP3上
+        return hint != AUDIO_FORMAT_UNKNOWN ? hint : AUDIO_FORMAT_MP3;
+    }
+    
+    if (sniff_mp3_frames(r, 0)) return AUDIO_FORMAT_MP3;
+    
+    // 内容看不出来，按扩展名试（比如开头有大段垃圾数据的MP3）
+    return hint;
+}
+
+// 各格式的解析结果统一转成AudioStreamInfo
+static void wav_to_stream_info(const WAVInfo* wav, AudioStreamInfo* out) {
+    unsigned int block_align = wav->channels * (wav->bits_per_sample / 8);
+    out->codec = AUDIO_CODEC_PCM;
+    out->sample_rate = wav->sample_rate;
+    out->channels = wav->channels;
+    out->bits_per_sample = wav->bits_per_sample;
+    out->bitrate = wav->sample_rate * wav->channels * wav->bits_per_sample;
+    out->total_samples = block_align ? wav->data_size / block_align : 0;
+    out->duration = wav->duration;
+}
+
+static void flac_to_stream_info(const FLACInfo* flac, long long file_size, AudioStreamInfo* out) {
+    out->codec = AUDIO_CODEC_FLAC;
+    out->sample_rate = flac->sample_rate;
+    out->channels = flac->channels;
+    out->bits_per_sample = flac->bits_per_sample;
+    out->is_vbr = 1;
+    out->total_samples = flac->total_samples;
+    out->duration = flac->duration;
+    if (flac->duration > 0 && flac->audio_offset > 0 && file_size > flac->audio_offset) {
+        out->bitrate = (unsigned int)((file_size - flac->audio_offset) * 8.0 / flac->duration);
+    }
+}
+
+static void ogg_to_stream_info(const OGGInfo* ogg, AudioStreamInfo* out) {
+    out->codec = ogg->codec;
+    out->sample_rate = ogg->sample_rate;
+    out->channels = ogg->channels;
+    out->is_vbr = 1;
+    out->total_samples = (unsigned long long)ogg->total_samples;
+    out->leading_samples = ogg->pre_skip;
+    out->duration = ogg->duration;
+    if (ogg->duration > 0) {
+        out->bitrate = (unsigned int)(ogg->file_size * 8.0 / ogg->duration);
+    }
+}
+
+static void mp3_to_stream_info(const MP3Info* mp3, AudioStreamInfo* out) {
+    if (mp3->layer == 1) out->codec = AUDIO_CODEC_MP1;
+    else if (mp3->layer == 2) out->codec = AUDIO_CODEC_MP2;
+    else out->codec = AUDIO_CODEC_MP3;
+    out->sample_rate = (unsigned int)mp3->sample_rate;
+    out->channels = (unsigned int)mp3->channels;
+    out->bitrate = (unsigned int)mp3->bitrate;
+    out->is_vbr = mp3->is_vbr;
+    out->estimated = mp3->estimated;
+    out->total_samples = (unsigned long long)mp3->total_samples;
+    out->leading_samples = (unsigned int)mp3->leading_samples;
+    out->trailing_samples = (unsigned int)mp3->trailing_samples;
+    out->duration = mp3->duration;
+}
+
+// 整数纳秒时长，分两段算避免total_samples * 1e9溢出，也不经过double舍入
+static void set_duration_ns(AudioStreamInfo* out) {
+    unsigned long long rate = out->sample_rate;
+    if (rate == 0) return;
+    out->duration_ns = out->total_samples / rate * 1000000000ULL +
+                       out->total_samples % rate * 1000000000ULL / rate;
+}
+
+// 嗅探格式后一次解析出全部流信息，返回错误码
+// duration_only时调用方只用时长，跳过只为其他字段才要的读取（FLAC不为比特率去找音频起点）
+static int parse_audio_info(BlockReader* r, int hint, int duration_only, AudioStreamInfo* out) {
+    memset(out, 0, sizeof(AudioStreamInfo));
+    out->struct_size = sizeof(AudioStreamInfo);
+    out->version = AUDIO_STREAM_INFO_VERSION;
+    
+    int ok = 0;
+    AP_STAT_PHASE(AP_PHASE_SNIFF);
+    int format = sniff_audio_format(r, hint);
+    AP_STAT_PHASE(AP_PHASE_PARSE);
+    
+    switch (format) {
+        case AUDIO_FORMAT_WAV: {
+            WAVInfo info;
+            ok = parse_wav(r, &info);
+            if (ok) wav_to_stream_info(&info, out);
+            break;
         }
-        
-        fseek(file, 0, SEEK_SET);
-        OGGPageHeader header;
-        long long data_size;
-        int first_granule_found = 0;
-        long long first_granule = 0;
-        long long last_granule = 0;
-        
-        while (read_ogg_page_header(file, &header, &data_size)) {
-            if (!first_granule_found && header.granule_position > 0) {
-                first_granule = header.granule_position;
-                first_granule_found = 1;
-            }
-            
-            if (header.granule_position > 0) {
-                last_granule = header.granule_position;
-            }
-            
-            fseek(file, (long)data_size, SEEK_CUR);
+        case AUDIO_FORMAT_FLAC: {
+            FLACInfo info;
+            ok = parse_flac(r, &info, !duration_only);
+            if (ok) flac_to_stream_info(&info, r->size, out);
+            break;
         }
-        
-        fclose(file);
-        
-        if (!first_granule_found || last_granule == 0) return 0;
-        
-        long long total_samples = last_granule - first_granule;
-        return (int)(total_samples / sample_rate);
-    }
-    // 尝试WAV格式
-    else if (strcasecmp(ext, ".wav") == 0) {
-        WAVInfo info;
-        if (parse_wav_file(filename, &info)) {
-            return (int)info.duration;
+        case AUDIO_FORMAT_OGG: {
+            OGGInfo info;
+            ok = parse_ogg(r, &info);
+            if (ok) ogg_to_stream_info(&info, out);
+            break;
+        }
+        case AUDIO_FORMAT_MP3: {
+            MP3Info info;
+            ok = parse_mp3(r, &info);
+            if (ok) mp3_to_stream_info(&info, out);
+            break;
         }
+        default:
+            out->error = AUDIO_ERR_UNKNOWN_FORMAT;
+            return out->error;
     }
     
+    if (ok) set_duration_ns(out);
+    out->error = ok ? AUDIO_OK : AUDIO_ERR_PARSE;
+    return out->error;
+}
+
+static int parse_audio_duration(BlockReader* r, int hint) {
+    AudioStreamInfo info;
+    if (parse_audio_info(r, hint, 1, &info) == AUDIO_OK) {
+        return (int)info.duration;
+    }
     return 0;
 }
 
-// 单独的格式检测函数
-int get_ogg_duration(const char* filename) {
-    if (!filename) return 0;
+// 按调用方声明的结构体大小回填，兼容旧版本结构体
+static int copy_stream_info(const AudioStreamInfo* src, AudioStreamInfo* dst) {
+    size_t size = dst->struct_size;
+    if (size < sizeof(unsigned int) * 3) return AUDIO_ERR_INVALID_ARG;
+    if (size > sizeof(AudioStreamInfo)) size = sizeof(AudioStreamInfo);
+    
+    memcpy((char*)dst + sizeof(unsigned int), (const char*)src + sizeof(unsigned int),
+           size - sizeof(unsigned int));
+    return src->error;
+}
+
+int get_audio_stream_info(const char* filename, AudioStreamInfo* info) {
+    if (!info) return AUDIO_ERR_INVALID_ARG;
     
-    FILE* file = fopen(filename, "rb");
-    if (!file) return 0;
+    AudioStreamInfo result;
+    memset(&result, 0, sizeof(result));
+    result.version = AUDIO_STREAM_INFO_VERSION;
     
-    unsigned int sample_rate = 0;
-    if (!find_first_audio_page(file, &sample_rate)) {
-        fclose(file);
-        return 0;
+    BlockReader reader;
+    if (!filename) {
+        result.error = AUDIO_ERR_INVALID_ARG;
+    } else if (!reader_open_file(&reader, filename)) {
+        result.error = AUDIO_ERR_OPEN;
+    } else {
+        parse_audio_info(&reader, format_from_extension(filename), 0, &result);
+        reader_close(&reader);
     }
+    return copy_stream_info(&result, info);
+}
+
+int get_audio_stream_info_from_buffer(const void* data, size_t size, AudioStreamInfo* info) {
+    if (!info) return AUDIO_ERR_INVALID_ARG;
     
-    if (sample_rate == 0) {
-        fclose(file);
-        return 0;
+    AudioStreamInfo result;
+    memset(&result, 0, sizeof(result));
+    result.version = AUDIO_STREAM_INFO_VERSION;
+    
+    if (!data) {
+        result.error = AUDIO_ERR_INVALID_ARG;
+    } else {
+        BlockReader reader;
+        reader_init_memory(&reader, data, size);
+        parse_audio_info(&reader, AUDIO_FORMAT_UNKNOWN, 0, &result);
+        reader_close(&reader);
     }
+    return copy_stream_info(&result, info);
+}
+
+// 检查调用方的AudioIO并补齐默认值，只复制调用方声明的大小
+static int normalize_audio_io(const AudioIO* io, AudioIO* out) {
+    memset(out, 0, sizeof(AudioIO));
+    if (!io || io->struct_size < sizeof(unsigned int)) return 0;
     
-    fseek(file, 0, SEEK_SET);
-    OGGPageHeader header;
-    long long data_size;
-    int first_granule_found = 0;
-    long long first_granule = 0;
-    long long last_granule = 0;
+    size_t size = io->struct_size < sizeof(AudioIO) ? io->struct_size : sizeof(AudioIO);
+    memcpy(out, io, size);
+    out->struct_size = sizeof(AudioIO);
+    if (!out->read_at || !out->size) return 0;
     
-    while (read_ogg_page_header(file, &header, &data_size)) {
-        if (!first_granule_found && header.granule_position > 0) {
-            first_granule = header.granule_position;
-            first_granule_found = 1;
-        }
-        
-        if (header.granule_position > 0) {
-            last_granule = header.granule_position;
-        }
+    if (out->head_bytes == 0) out->head_bytes = READER_BLOCK_SIZE;
+    if (out->request_bytes == 0) out->request_bytes = READER_BLOCK_SIZE;
+    if (out->head_bytes > READER_MAX_PREFETCH) out->head_bytes = READER_MAX_PREFETCH;
+    if (out->tail_bytes > READER_MAX_PREFETCH) out->tail_bytes = READER_MAX_PREFETCH;
+    if (out->request_bytes > READER_MAX_PREFETCH) out->request_bytes = READER_MAX_PREFETCH;
+    return 1;
+}
+
+// 先只在已取到的区间上试解析，缺哪段就补读哪段再试；区间数用完后退回逐块读
+// 多数文件在头部一次请求、加上尾部或标签后面一次请求内解析完
+static int parse_audio_info_io(BlockReader* r, int hint, int duration_only, AudioStreamInfo* out) {
+    for (;;) {
+        r->nonblocking = 1;
+        r->miss_len = 0;
+        parse_audio_info(r, hint, duration_only, out);
+        r->nonblocking = 0;
         
-        fseek(file, (long)data_size, SEEK_CUR);
+        if (r->miss_len == 0) return out->error;
+        if (!reader_fetch_miss(r, r->miss_offset, r->miss_len)) break;
     }
+    return parse_audio_info(r, hint, duration_only, out);
+}
+
+// 自定义I/O上解析，结果总是写满整个out
+static void audio_info_from_io(const AudioIO* io, const char* name_hint, int duration_only, AudioStreamInfo* out) {
+    memset(out, 0, sizeof(AudioStreamInfo));
+    out->version = AUDIO_STREAM_INFO_VERSION;
     
-    fclose(file);
-    
-    if (!first_granule_found || last_granule == 0) return 0;
+    AudioIO normalized;
+    BlockReader reader;
+    if (!normalize_audio_io(io, &normalized)) {
+        out->error = AUDIO_ERR_INVALID_ARG;
+    } else if (!reader_open_io(&reader, &normalized)) {
+        out->error = AUDIO_ERR_OPEN;
+    } else {
+        parse_audio_info_io(&reader, format_from_extension(name_hint), duration_only, out);
+        // 读到一半出错时解析器会把已读到的部分当成整个文件，这种结果不能交出去
+        if (reader.io_error) {
+            memset(out, 0, sizeof(AudioStreamInfo));
+            out->version = AUDIO_STREAM_INFO_VERSION;
+            out->error = AUDIO_ERR_OPEN;
+        }
+        reader_close(&reader);
+    }
+}
+
+int get_audio_stream_info_from_io(const AudioIO* io, const char* name_hint, AudioStreamInfo* info) {
+    if (!info) return AUDIO_ERR_INVALID_ARG;
     
-    long long total_samples = last_granule - first_granule;
-    return (int)(total_samples / sample_rate);
+    AudioStreamInfo result;
+    audio_info_from_io(io, name_hint, 0, &result);
+    return copy_stream_info(&result, info);
 }
 
-int get_flac_duration(const char* filename) {
-    if (!filename) return 0;
+int get_audio_duration_from_io(const AudioIO* io, const char* name_hint) {
+    AudioStreamInfo info;
+    audio_info_from_io(io, name_hint, 1, &info);
+    if (info.error != AUDIO_OK) return 0;
+    return (int)info.duration;
+}
+
+// 限定读盘量的估算：调用方给出字节预算，读取只发生在头部、中部、尾部几个窗口内
+// WAV头部就有精确值；FLAC头部有总样本数时是精确值，总样本数为0时从尾部找末帧，找不到按第一帧到尾部候选帧的平均帧长外推；
+// Ogg首尾granule能取到时是精确值，否则按中部页外推；MP3有Xing/VBRI帧数时是精确值，否则在三个窗口里各走一段帧，按平均每样本字节数外推
+#define ESTIMATE_DEFAULT_BUDGET 65536
+#define ESTIMATE_MIN_BUDGET     16384
+#define ESTIMATE_OGG_SLACK      0.2     // Ogg外推部分按±20%计误差
+
+typedef struct {
+    long long start;                // 第一个接得上的帧的位置
+    long long frames;
+    long long bytes;
+    double bytes_sq;                // 帧长平方和，用来算帧长方差
+    long long samples;
+    int sample_rate;
+} MP3Sample;
+
+// 在[pos, limit)里找到第一个能与下一帧接上的帧，然后逐帧走到limit为止
+static long long sample_mp3_region(BlockReader* r, long long pos, long long limit, long long audio_end,
+                                   MP3Sample* sample) {
+    memset(sample, 0, sizeof(MP3Sample));
+    if (limit > audio_end) limit = audio_end;
     
-    FLACInfo info;
-    if (parse_flac_file(filename, &info)) {
-        return (int)info.duration;
+    pos = find_mp3_sync(r, pos, limit);
+    while (pos >= 0 && !check_mp3_frames_at(r, pos)) {
+        pos = find_mp3_sync(r, pos + 1, limit);
     }
-    return 0;
+    if (pos < 0) return -1;
+    sample->start = pos;
+    
+    while (pos + 4 <= limit) {
+        const unsigned char* p = reader_span(r, pos, 4);
+        MP3FrameHeader header;
+        if (!p || !parse_mp3_header((unsigned char*)p, &header)) break;
+        if (sample->frames > 0 && header.sample_rate != sample->sample_rate) break;
+        if (pos + header.frame_size > audio_end) break;
+        
+        if (sample->frames == 0) sample->sample_rate = header.sample_rate;
+        
+        sample->frames++;
+        sample->bytes += header.frame_size;
+        sample->bytes_sq += (double)header.frame_size * header.frame_size;
+        sample->samples += get_mp3_samples_per_frame(&header);
+        pos += header.frame_size;
+    }
+    return pos;
 }
 
-int get_mp3_duration_export(const char* filename) {
-    return get_mp3_duration_optimized(filename);
+// 牛顿迭代开方，免得为一处误差计算引入libm
+static double estimate_sqrt(double x) {
+    if (x <= 0) return 0;
+    double y = x > 1 ? x : 1;
+    for (int i = 0; i < 64; i++) {
+        double next = 0.5 * (y + x / y);
+        if (next >= y) break;
+        y = next;
+    }
+    return y;
 }
 
-int get_wav_duration(const char* filename) {
-    if (!filename) return 0;
+static int estimate_mp3(BlockReader* r, long long window, AudioDurationEstimate* out) {
+    long long audio_start = skip_id3v2_tag(r);
+    long long audio_end = r->size;
+    long long head_end = audio_start + window < audio_end ? audio_start + window : audio_end;
     
-    WAVInfo info;
-    if (parse_wav_file(filename, &info)) {
-        return (int)info.duration;
+    // 第一帧：有Xing/VBRI帧数就是精确值
+    long long pos = find_mp3_sync(r, audio_start, head_end);
+    while (pos >= 0 && !check_mp3_frames_at(r, pos)) {
+        pos = find_mp3_sync(r, pos + 1, head_end);
     }
-    return 0;
+    
+    // 头部窗口里没有帧（大封面之后还跟着一段垃圾数据）：音频起点不确定，只按中部和尾部窗口外推
+    int head_missing = pos < 0;
+    if (head_missing) {
+        if (head_end >= audio_end) return 0;
+        audio_start = head_end;
+    } else {
+        const unsigned char* p = reader_span(r, pos, 4);
+        MP3FrameHeader header;
+        if (!p || !parse_mp3_header((unsigned char*)p, &header)) return 0;
+        
+        MP3VBRHeader vbr;
+        if (read_vbr_header(r, pos, &header, &vbr)) {
+            if (vbr.frames > 0) {
+                MP3Info info;
+                memset(&info, 0, sizeof(MP3Info));
+                if (!mp3_info_from_vbr(&header, &vbr, &info)) return 0;
+                out->exact = 1;
+                out->duration = info.duration;
+                AP_STAT_STRATEGY(AP_STRATEGY_XING);
+                return 1;
+            }
+            pos += header.frame_size;
+        }
+        audio_start = pos;
+    }
+    
+    // 去掉尾部的ID3v1标签
+    if (audio_end - 128 > audio_start) {
+        const unsigned char* p = reader_span(r, audio_end - 128, 3);
+        if (p && memcmp(p, "TAG", 3) == 0) audio_end -= 128;
+    }
+    
+    // 音频不超过三个窗口就整段走一遍；头部窗口走到结尾时就是完整遍历
+    MP3Sample samples[3];
+    int count = 0;
+    long long stop = audio_start;
+    if (!head_missing) {
+        long long head_limit = audio_end - audio_start <= window * 3 ? audio_end : audio_start + window;
+        stop = sample_mp3_region(r, audio_start, head_limit, audio_end, &samples[0]);
+        if (stop < 0 || samples[0].frames == 0) return 0;
+        count = 1;
+        
+        if (stop + 4 > audio_end) {
+            out->exact = 1;
+            out->duration = (double)samples[0].samples / samples[0].sample_rate;
+            AP_STAT_STRATEGY(AP_STRATEGY_FULL_WALK);
+            return 1;
+        }
+    }
+    
+    long long regions[2] = { audio_start + (audio_end - audio_start) / 2, audio_end - window };
+    for (int i = 0; i < 2; i++) {
+        if (regions[i] < stop) continue;
+        if (sample_mp3_region(r, regions[i], regions[i] + window, audio_end, &samples[count]) >= 0 &&
+            samples[count].frames > 0 && (count == 0 || samples[count].sample_rate == samples[0].sample_rate)) {
+            count++;
+        }
+    }
+    if (count == 0) return 0;
+    
+    // 合并各窗口按平均帧长外推帧数；误差取平均帧长标准误的三倍，再加两帧的边界误差
+    MP3Sample all = samples[0];
+    for (int i = 1; i < count; i++) {
+        all.frames += samples[i].frames;
+        all.bytes += samples[i].bytes;
+        all.bytes_sq += samples[i].bytes_sq;
+        all.samples += samples[i].samples;
+    }
+    
+    double mean = (double)all.bytes / all.frames;
+    double variance = all.bytes_sq / all.frames - mean * mean;
+    if (variance < 0) variance = 0;
+    double relative_error = 3.0 * estimate_sqrt(variance / all.frames) / mean;
+    if (all.frames < 8) relative_error = 1.0;  // 样本太少，方差本身不可信
+    double frame_seconds = (double)all.samples / all.frames / all.sample_rate;
+    
+    out->exact = 0;
+    out->duration = (double)(audio_end - audio_start) / mean * frame_seconds;
+    out->error_bound = out->duration * relative_error + 2 * frame_seconds;
+    
+    // 起点不确定时按音频紧接头部窗口算，误差再加上头部窗口到第一个采到的帧之间可能全是垃圾数据的那段
+    if (head_missing) out->error_bound += (double)(samples[0].start - audio_start) / mean * frame_seconds;
+    AP_STAT_STRATEGY(AP_STRATEGY_ESTIMATE);
+    return 1;
 }
 
-// 导出所有函数供Python使用
-__declspec(dllexport) int GetAudioDuration(const char* filename) {
-    return get_audio_duration(filename);
+// FLAC：STREAMINFO里有总样本数就是精确值。流式编码的总样本数为0，从尾部往回找末帧，窗口从window起一直扩到预算用完；
+// 帧太大、窗口里认不出末帧时，取尾部最后一个候选帧头：第一帧到它之间的平均每样本字节数就是平均帧长折算出来的，
+// 用它外推候选帧之后剩下的字节
+static int estimate_flac(BlockReader* r, long long window, AudioDurationEstimate* out) {
+    FLACInfo info;
+    memset(&info, 0, sizeof(FLACInfo));
+    long long start = check_flac_signature(r);
+    if (start == 0) return 0;
+    
+    FLACCandidate last;
+    int exact = parse_flac_metadata(r, &info, start, 0);
+    if (!exact) {
+        if (info.total_samples != 0) return 0;
+        // 读取按4KB对齐，最大窗口少给一个对齐量才读得到文件尾；超出预算读不到的部分扫到哪里算哪里
+        exact = flac_tail_total(r, &info, window, r->budget - r->bytes_read - READER_ALIGN, &last);
+        if (exact) AP_STAT_STRATEGY(AP_STRATEGY_FLAC_TAIL);
+    }
+    if (exact) {
+        out->exact = 1;
+        out->duration = info.duration;
+        return 1;
+    }
+    if (last.offset <= info.audio_offset) return 0;
+    
+    // 候选帧头没有和别的帧接上，可能是假的：平均每样本字节数超过原始PCM的大小就不信它
+    unsigned long long first = flac_frame_first_sample(&last.header, &info);
+    if (first == 0) return 0;
+    double bytes_per_sample = (double)(last.offset - info.audio_offset) / (double)first;
+    if (bytes_per_sample > info.channels * info.bits_per_sample / 8.0 * 1.1 + 1) return 0;
+    
+    // 候选帧之后的字节压缩率不知道，误差按外推出的样本数整个计
+    double rest = (double)(r->size - last.offset) / bytes_per_sample;
+    if (rest < last.header.block_size) rest = last.header.block_size;
+    out->exact = 0;
+    out->duration = ((double)first + rest) / info.sample_rate;
+    out->error_bound = rest / info.sample_rate;
+    AP_STAT_STRATEGY(AP_STRATEGY_ESTIMATE);
+    return 1;
 }
 
-__declspec(dllexport) int GetOggDuration(const char* filename) {
-    return get_ogg_duration(filename);
-}
+// 窗口里最后一个带granule的页，以及同一逻辑流在窗口里最早的一页（两页之间的码率用于外推）
+typedef struct {
+    unsigned int serial;
+    long long granule;
+    long long first_granule;
+    long long first_end;
+} OGGGranuleRun;
 
-__declspec(dllexport) int GetFlacDuration(const char* filename) {
-    return get_flac_duration(filename);
+// 在[offset, offset + window)里找属于serial（OGG_ANY_SERIAL时不限）、带granule的页，取最后一个；只看页头不校验CRC
+// 返回页尾偏移，找不到返回-1
+static long long find_ogg_granule_near(BlockReader* r, long long offset, long long window, long long serial,
+                                       OGGGranuleRun* run) {
+    size_t avail;
+    const unsigned char* p = reader_window(r, offset, OGG_PAGE_HEADER_SIZE, &avail);
+    if (!p) return -1;
+    if ((long long)avail > window) avail = (size_t)window;
+    
+    long long page_end = -1;
+    for (size_t i = 0; i + OGG_PAGE_HEADER_SIZE <= avail; i++) {
+        if (p[i] != 'O' || memcmp(p + i, OGG_PAGE_HEADER, 4) != 0) continue;
+        
+        OGGPageHeader header;
+        if (!decode_ogg_page_header(p + i, &header) || header.version != 0 ||
+            (serial != OGG_ANY_SERIAL && header.bitstream_serial != (unsigned int)serial) ||
+            header.granule_position == 0 || header.granule_position == OGG_GRANULE_NONE) {
+            continue;
+        }
+        
+        // 段表不在窗口内就算不出页长
+        size_t table = i + OGG_PAGE_HEADER_SIZE;
+        if (table + header.page_segments > avail) break;
+        long long data_size = 0;
+        for (int k = 0; k < header.page_segments; k++) data_size += p[table + k];
+        
+        long long end = offset + (long long)table + header.page_segments + data_size;
+        if (end > r->size) continue;
+        if (page_end < 0 || header.bitstream_serial != run->serial) {
+            run->serial = header.bitstream_serial;
+            run->first_granule = (long long)header.granule_position;
+            run->first_end = end;
+        }
+        run->granule = (long long)header.granule_position;
+        page_end = end;
+    }
+    return page_end;
 }
 
-__declspec(dllexport) int GetMp3Duration(const char* filename) {
-    return get_mp3_duration_export(filename);
+// 链式Ogg：后面几节换了序列号，granule从每节开头重新计，第一节的流在尾部和中部都找不到。
+// 取尾部窗口里任意流最后一个带granule的页，用它所在流在窗口内的码率和第一节开头的码率的平均值
+// 把第一个granule页之后的字节全部外推，两个码率之差也计入误差。
+// 尾部这个流的编码不知道（可能是复用进来的视频流），码率和开头差出一倍以上就不信它，只用开头的码率；
+// 各节按第一节的采样率折算，外推部分另按±20%计误差
+static int estimate_ogg_chain(BlockReader* r, long long tail, long long window, OGGInfo* info, long long first_end,
+                              double head_rate, AudioDurationEstimate* out) {
+    if (head_rate <= 0) return 0;
+    
+    OGGGranuleRun run;
+    memset(&run, 0, sizeof(run));
+    long long page_end = find_ogg_granule_near(r, tail, window, OGG_ANY_SERIAL, &run);
+    
+    double granules_per_byte = head_rate;
+    double spread = 0;
+    double known = (double)info->first_granule_position;
+    if (page_end > first_end && page_end > run.first_end && run.granule > run.first_granule) {
+        double tail_rate = (double)(run.granule - run.first_granule) / (double)(page_end - run.first_end);
+        if (tail_rate > head_rate / 2 && tail_rate < head_rate * 2) {
+            granules_per_byte = (head_rate + tail_rate) / 2;
+            spread = (tail_rate > head_rate ? tail_rate - head_rate : head_rate - tail_rate) / 2;
+            known += (double)run.granule;  // 最后一节已经播到run.granule，总数至少有这么多
+        }
+    }
+    
+    double bytes = (double)(r->size - first_end);
+    double total = (double)info->first_granule_position + granules_per_byte * bytes;
+    if (total < known) total = known;
+    info->last_granule_position = (long long)total;
+    if (!ogg_set_duration(info)) return 0;
+    
+    out->exact = 0;
+    out->duration = info->duration;
+    out->error_bound = ((total - known) * ESTIMATE_OGG_SLACK + spread * bytes) / info->sample_rate;
+    AP_STAT_STRATEGY(AP_STRATEGY_ESTIMATE);
+    return 1;
 }
 
-__declspec(dllexport) int GetWavDuration(const char* filename) {
-    return get_wav_duration(filename);
-}
\ No newline at end of file
+static int estimate_ogg(BlockReader* r, long long window, AudioDurationEstimate* out) {
+    // 外推要用的第一节头部先取好：快速路径失败时块缓冲里早已不是头部，再读一遍会吃掉尾部窗口的预算
+    OGGLink link;
+    OGGInfo info;
+    long long first_end = 0;
+    double head_rate = 0;                   // 头部窗口里第一节音频流每字节的granule数
+    int have_head = read_ogg_link_head(r, 0, &link);
+    info = link.info;
+    if (have_head) have_head = find_first_granule(r, &info, 0, r->size, &first_end);
+    if (have_head && info.first_granule_position > 0) {
+        OGGGranuleRun run;
+        memset(&run, 0, sizeof(run));
+        head_rate = (double)info.first_granule_position / (double)first_end;
+        long long end = find_ogg_granule_near(r, 0, window, info.bitstream_serial, &run);
+        if (end > run.first_end && run.granule > run.first_granule) {
+            head_rate = (double)(run.granule - run.first_granule) / (double)(end - run.first_end);
+        }
+    }
+    
+    // 快速路径少给一个窗口的预算，尾页CRC校验读不下时还留有余量做外推
+    long long budget = r->budget;
+    r->budget = budget - window;
+    OGGInfo exact;
+    int ok = parse_ogg(r, &exact);
+    r->budget = budget;
+    
+    if (ok) {
+        out->exact = 1;
+        out->duration = exact.duration;
+        return 1;
+    }
+    if (!have_head) return 0;
+    
+    // 先在尾部窗口找第一节音频流的最后一页，找不到再看中部
+    OGGGranuleRun run;
+    memset(&run, 0, sizeof(run));
+    long long tail = r->size - window;
+    if (tail < first_end) tail = first_end;
+    long long page_end = find_ogg_granule_near(r, tail, window, info.bitstream_serial, &run);
+    if (page_end < 0) {
+        page_end = find_ogg_granule_near(r, r->size / 2, window, info.bitstream_serial, &run);
+    }
+    if (page_end < 0) return estimate_ogg_chain(r, tail, window, &info, first_end, head_rate, out);
+    long long granule = run.granule;
+    if (page_end <= first_end || granule <= info.first_granule_position) return 0;
+    
+    // 找到的页正好结束在文件末尾，就是最后一页
+    if (page_end == r->size) {
+        info.last_granule_position = granule;
+        if (!ogg_set_duration(&info)) return 0;
+        out->exact = 1;
+        out->duration = info.duration;
+        AP_STAT_STRATEGY(AP_STRATEGY_OGG_TAIL);
+        return 1;
+    }
+    
+    // 用首个granule页到找到的页之间的码率外推剩下的字节
+    double granules_per_byte = (double)(granule - info.first_granule_position) / (double)(page_end - first_end);
+    double tail_granules = granules_per_byte * (double)(r->size - page_end);
+    info.last_granule_position = granule + (long long)tail_granules;
+    if (!ogg_set_duration(&info)) return 0;
+    
+    out->exact = 0;
+    out->duration = info.duration;
+    out->error_bound = tail_granules / info.sample_rate * ESTIMATE_OGG_SLACK;
+    AP_STAT_STRATEGY(AP_STRATEGY_ESTIMATE);
+    return 1;
+}
+
+int get_audio_duration_estimate(const char* filename, long long byte_budget, AudioDurationEstimate* estimate) {
+    if (!estimate) return AUDIO_ERR_INVALID_ARG;
+    
+    AudioDurationEstimate result;
+    memset(&result, 0, sizeof(result));
+    result.version = AUDIO_DURATION_ESTIMATE_VERSION;
+    
+    if (byte_budget <= 0) byte_budget = ESTIMATE_DEFAULT_BUDGET;
+    if (byte_budget < ESTIMATE_MIN_BUDGET) byte_budget = ESTIMATE_MIN_BUDGET;
+    
+    BlockReader reader;
+    if (!filename) {
+        result.error = AUDIO_ERR_INVALID_ARG;
+    } else if (!reader_open_bounded(&reader, filename, byte_budget)) {
+        result.error = AUDIO_ERR_OPEN;
+    } else {
+        // 头、中、尾三个窗口加上头部标签，各分四分之一
+        long long window = byte_budget / 4;
+        
+        int ok = 0;
+        int format = sniff_audio_format(&reader, format_from_extension(filename));
+        if (format == AUDIO_FORMAT_WAV) {
+            WAVInfo info;
+            ok = parse_wav(&reader, &info);
+            result.duration = info.duration;
+            result.exact = 1;
+        } else if (format == AUDIO_FORMAT_FLAC) {
+            ok = estimate_flac(&reader, window, &result);
+        } else if (format == AUDIO_FORMAT_OGG) {
+            ok = estimate_ogg(&reader, window, &result);
+        } else if (format == AUDIO_FORMAT_MP3) {
+            ok = estimate_mp3(&reader, window, &result);
+        }
+        
+        if (format == AUDIO_FORMAT_UNKNOWN) result.error = AUDIO_ERR_UNKNOWN_FORMAT;
+        else if (!ok) result.error = AUDIO_ERR_PARSE;
+        result.bytes_read = reader.bytes_read;
+        reader_close(&reader);
+    }
+    
+    if (result.error != AUDIO_OK) {
+        result.exact = 0;
+        result.duration = 0;
+        result.error_bound = 0;
+    }
+    
+    size_t size = estimate->struct_size;
+    if (size < sizeof(unsigned int) * 3) return AUDIO_ERR_INVALID_ARG;
+    if (size > sizeof(AudioDurationEstimate)) size = sizeof(AudioDurationEstimate);
+    memcpy((char*)estimate + sizeof(unsigned int), (const char*)&result + sizeof(unsigned int),
+           size - sizeof(unsigned int));
+    return result.error;
+}
+
+// 推式流解析：数据分块送进来，边收边解析，从不回头读
+// 每一步声明“从skip_to开始要need字节”，之前的数据直接丢弃；要的区间若跨块就先攒进内部缓冲区，
+// 否则直接在调用方的数据上解析。WAV/FLAC/Xing在头部就能给出时长，Ogg/MP3逐页逐帧走到结尾
+#define STREAM_BUFFER_SIZE 8192     // 嗅探窗口（SNIFF_SIZE加一帧的余量），也大于最大的MP3帧和Ogg页头+段表
+
+#define STREAM_NEED_DATA      0     // FeedStreamParser返回：时长还不知道
+#define STREAM_DURATION_READY 1     // 时长已确定（WAV/FLAC/Xing头部），后续数据不会再改变它
+#define STREAM_FAILED        -1     // 格式无法识别或数据损坏
+
+#define STREAM_SNIFF           0
+#define STREAM_WAV_HEADER      1
+#define STREAM_WAV_CHUNK       2
+#define STREAM_WAV_FMT         3
+#define STREAM_FLAC_SIGNATURE  4
+#define STREAM_FLAC_BLOCK      5
+#define STREAM_FLAC_STREAMINFO 6
+#define STREAM_FLAC_FRAME      7    // 总样本数为0的流式FLAC：顺着帧头走到结尾
+#define STREAM_OGG_PAGE        8
+#define STREAM_OGG_SEGMENTS    9
+#define STREAM_OGG_DATA        10
+#define STREAM_OGG_TOC         11
+#define STREAM_MP3_ID3         12
+#define STREAM_MP3_FRAME       13
+#define STREAM_MP3_FIRST       14
+#define STREAM_DONE            15   // 不再需要数据，只计字节数
+
+typedef struct {
+    int format;
+    int hint;
+    int state;
+    int ready;
+    int failed;
+    int eof;
+    long long pos;                  // 已收到的总字节数
+    long long skip_to;              // 下一步要看的区间起点
+    size_t need;                    // 下一步至少要的字节数
+    size_t buffered;                // buf里从skip_to开始攒下的字节数
+    
+    // WAV
+    WAVInfo wav;
+    int wav_fmt_found;
+    unsigned int wav_format;
+    long long wav_next_chunk;
+    long long wav_data_offset;    // data块长度未知（边录边传）时，到结尾按实际字节数算
+    
+    // FLAC
+    FLACInfo flac;
+    int flac_last;
+    FLACChain flac_chain;           // STREAMINFO没有总样本数时认帧，最后接上的就是末帧
+    
+    // Ogg
+    OGGInfo ogg;                    // 当前这一节
+    OGGInfo ogg_chain;              // 链式Ogg前面各节的合计
+    OGGPageHeader ogg_header;
+    long long ogg_page_start;
+    long long ogg_page_end;
+    int ogg_page_index;
+    int ogg_granule_found;
+    unsigned char ogg_lacing[255];  // Opus首个音频页的段表，逐包读TOC推出起始granule
+    int ogg_lacing_index;
+    long long ogg_packet_pos;
+    long long ogg_packet_len;
+    long long ogg_page_samples;
+    
+    // MP3
+    MP3Info mp3;
+    MP3FrameHeader mp3_header;
+    int mp3_first;
+    int mp3_first_bitrate;
+    long long mp3_bytes;
+    
+    unsigned char buf[STREAM_BUFFER_SIZE];
+} StreamParser;
+
+static void stream_expect(StreamParser* s, int state, long long offset, size_t need) {
+    s->state = state;
+    s->skip_to = offset;
+    s->need = need;
+}
+
+static void stream_stop(StreamParser* s, int failed) {
+    s->state = STREAM_DONE;
+    if (failed) s->failed = 1;
+}
+
+static void stream_sniff(StreamParser* s, const unsigned char* p, size_t avail) {
+    BlockReader reader;
+    reader_init_memory(&reader, p, avail);
+    s->format = sniff_audio_format(&reader, s->hint);
+    
+    // FLAC/WAV的签名可能在ID3v2标签之后；标签超出嗅探窗口时找不到，仍从0开始，在签名处失败
+    long long start = 0;
+    if (s->format == AUDIO_FORMAT_WAV) start = find_signature(&reader, WAV_RIFF_HEADER);
+    else if (s->format == AUDIO_FORMAT_FLAC) start = find_signature(&reader, FLAC_SIGNATURE);
+    if (start < 0) start = 0;
+    reader_close(&reader);
+    
+    if (s->format == AUDIO_FORMAT_WAV) stream_expect(s, STREAM_WAV_HEADER, start, 12);
+    else if (s->format == AUDIO_FORMAT_FLAC) stream_expect(s, STREAM_FLAC_SIGNATURE, start, 4);
+    else if (s->format == AUDIO_FORMAT_OGG) stream_expect(s, STREAM_OGG_PAGE, 0, OGG_PAGE_HEADER_SIZE);
+    else if (s->format == AUDIO_FORMAT_MP3) stream_expect(s, STREAM_MP3_ID3, 0, 10);
+    else stream_stop(s, 1);
+}
+
+static void stream_wav(StreamParser* s, const unsigned char* p, long long at) {
+    if (s->state == STREAM_WAV_HEADER) {
+        if (memcmp(p, WAV_RIFF_HEADER, 4) != 0 || memcmp(p + 8, WAV_WAVE_HEADER, 4) != 0) {
+            stream_stop(s, 1);
+            return;
+        }
+        stream_expect(s, STREAM_WAV_CHUNK, at + 12, 8);
+        return;
+    }
+    
+    if (s->state == STREAM_WAV_FMT) {
+        s->wav_format = read_le16(p);
+        s->wav.channels = read_le16(p + 2);
+        s->wav.sample_rate = read_le32(p + 4);
+        s->wav.bits_per_sample = read_le16(p + 14);
+        s->wav_fmt_found = 1;
+        stream_expect(s, STREAM_WAV_CHUNK, s->wav_next_chunk, 8);
+        return;
+    }
+    
+    unsigned int chunk_size = read_le32(p + 4);
+    s->wav_next_chunk = at + 8 + (long long)chunk_size + (chunk_size & 1);
+    
+    if (memcmp(p, WAV_FMT_HEADER, 4) == 0) {
+        stream_expect(s, STREAM_WAV_FMT, at + 8, 16);
+        return;
+    }
+    if (memcmp(p, WAV_DATA_HEADER, 4) != 0 || !s->wav_fmt_found) {
+        stream_expect(s, STREAM_WAV_CHUNK, s->wav_next_chunk, 8);
+        return;
+    }
+    
+    // 只支持PCM格式
+    unsigned int block_align = s->wav.channels * (s->wav.bits_per_sample / 8);
+    if (s->wav_format != 1 || s->wav.sample_rate == 0 || block_align == 0) {
+        stream_stop(s, 1);
+        return;
+    }
+    
+    // 边录边传的WAV常把data长度写成0或0xFFFFFFFF，这种要等到结尾
+    s->wav_data_offset = at + 8;
+    if (chunk_size == 0 || chunk_size == 0xFFFFFFFFu) {
+        stream_stop(s, 0);
+        return;
+    }
+    
+    s->wav.data_size = chunk_size;
+    s->wav.duration = (double)(chunk_size / block_align) / s->wav.sample_rate;
+    s->ready = 1;
+    stream_stop(s, 0);
+}
+
+// 在手头数据里逐个找帧头喂给flac_chain，认帧规则和flac_tail_total相同；
+// 帧头最长16字节，离数据末尾不到16字节的同步码留到下一块再看，收尾时才按剩下的字节解析
+static void stream_flac_frames(StreamParser* s, const unsigned char* p, size_t avail, long long at) {
+    size_t i = 0;
+    while (i < avail) {
+        const unsigned char* sync = (const unsigned char*)memchr(p + i, 0xFF, avail - i);
+        if (!sync) {
+            i = avail;
+            break;
+        }
+        i = (size_t)(sync - p);
+        if (i + 1 == avail) break;  // 同步码可能跨块
+        if ((p[i + 1] & 0xFE) != 0xF8) {
+            i++;
+            continue;
+        }
+        if (!s->eof && avail - i < FLAC_MAX_FRAME_HEADER) break;
+        
+        FLACCandidate candidate;
+        candidate.offset = at + (long long)i;
+        if (parse_flac_frame_header(p + i, avail - i, &s->flac, &candidate.header)) {
+            flac_chain_add(&s->flac_chain, &s->flac, &candidate);
+        }
+        i++;
+    }
+    stream_expect(s, STREAM_FLAC_FRAME, at + (long long)i, FLAC_MAX_FRAME_HEADER);
+}
+
+static void stream_flac(StreamParser* s, const unsigned char* p, size_t avail, long long at) {
+    if (s->state == STREAM_FLAC_FRAME) {
+        stream_flac_frames(s, p, avail, at);
+        return;
+    }
+    
+    if (s->state == STREAM_FLAC_SIGNATURE) {
+        if (memcmp(p, FLAC_SIGNATURE, 4) != 0) {
+            stream_stop(s, 1);
+            return;
+        }
+        stream_expect(s, STREAM_FLAC_BLOCK, at + 4, 4);
+        return;
+    }
+    
+    long long next;
+    if (s->state == STREAM_FLAC_STREAMINFO) {
+        parse_streaminfo_block(p, &s->flac, 34);
+        if (s->flac.duration > 0) s->ready = 1;
+        next = at + 34;
+    } else {
+        unsigned int block_info = read_be32(p);
+        int block_type = (block_info >> 24) & 0x7F;
+        unsigned int block_length = block_info & 0xFFFFFF;
+        s->flac_last = (block_info >> 31) & 0x01;
+        
+        if (block_type == 0 && block_length == 34) {
+            stream_expect(s, STREAM_FLAC_STREAMINFO, at + 4, 34);
+            return;
+        }
+        next = at + 4 + (long long)block_length;
+    }
+    
+    // 走到最后一个元数据块就得到音频起点，之后的帧数据不再需要；
+    // 流式编码的FLAC总样本数为0，要顺着帧走到结尾，收尾时按末帧算
+    if (s->flac_last) {
+        s->flac.audio_offset = next;
+        if (!s->ready && s->flac.total_samples == 0 && s->flac.sample_rate > 0 && s->flac.max_block_size > 0) {
+            flac_chain_init(&s->flac_chain, next, 0);
+            stream_expect(s, STREAM_FLAC_FRAME, next, FLAC_MAX_FRAME_HEADER);
+            return;
+        }
+        stream_stop(s, s->flac.duration <= 0);
+        return;
+    }
+    stream_expect(s, STREAM_FLAC_BLOCK, next, 4);
+}
+
+// Opus首个音频页：依次读各个结束在本页的包的TOC，读完再去找下一页
+static void stream_opus_next_toc(StreamParser* s) {
+    s->ogg_packet_len = 0;
+    while (s->ogg_lacing_index < s->ogg_header.page_segments) {
+        int lacing = s->ogg_lacing[s->ogg_lacing_index++];
+        s->ogg_packet_len += lacing;
+        if (lacing == 255 || s->ogg_packet_len == 0) continue;
+        
+        stream_expect(s, STREAM_OGG_TOC, s->ogg_packet_pos, s->ogg_packet_len < 2 ? 1 : 2);
+        return;
+    }
+    ogg_set_start(&s->ogg, s->ogg_page_samples);
+    stream_expect(s, STREAM_OGG_PAGE, s->ogg_page_end, OGG_PAGE_HEADER_SIZE);
+}
+
+static void stream_ogg(StreamParser* s, const unsigned char* p, long long at) {
+    OGGPageHeader* header = &s->ogg_header;
+    
+    if (s->state == STREAM_OGG_TOC) {
+        s->ogg_page_samples += opus_packet_samples(p, s->need);
+        s->ogg_packet_pos += s->ogg_packet_len;
+        stream_opus_next_toc(s);
+        return;
+    }
+    
+    if (s->state == STREAM_OGG_PAGE) {
+        // 同步丢失就停下，和整段遍历一样按已经走过的页算
+        if (!decode_ogg_page_header(p, header)) {
+            stream_stop(s, 0);
+            return;
+        }
+        s->ogg_page_start = at;
+        stream_expect(s, STREAM_OGG_SEGMENTS, at + OGG_PAGE_HEADER_SIZE, header->page_segments);
+        if (header->page_segments > 0) return;
+        p = NULL;
+    }
+    
+    if (s->state == STREAM_OGG_SEGMENTS) {
+        long long data_size = 0;
+        for (int i = 0; i < header->page_segments; i++) data_size += p[i];
+        long long data_pos = s->ogg_page_start + OGG_PAGE_HEADER_SIZE + header->page_segments;
+        s->ogg_page_end = data_pos + data_size;
+        
+        // 音频数据之后又出现BOS页，说明上一节结束了：并进合计，重新认编码头
+        if ((header->header_type & 2) && s->ogg_granule_found) {
+            if (ogg_set_duration(&s->ogg)) ogg_add_link(&s->ogg_chain, &s->ogg);
+            memset(&s->ogg, 0, sizeof(OGGInfo));
+            s->ogg_granule_found = 0;
+            s->ogg_page_index = 0;
+        }
+        s->ogg.total_pages++;
+        
+        if (s->ogg.sample_rate == 0) {
+            // 编码头必须在前10页里，读数据开头认出Vorbis/Opus
+            if (s->ogg_page_index++ >= 10) {
+                stream_stop(s, 1);
+                return;
+            }
+            if (data_size > 0) {
+                stream_expect(s, STREAM_OGG_DATA, data_pos, data_size < 100 ? (size_t)data_size : 100);
+                return;
+            }
+        } else if (header->bitstream_serial == s->ogg.bitstream_serial &&
+                   header->granule_position > 0 && header->granule_position != OGG_GRANULE_NONE) {
+            s->ogg.last_granule_position = (long long)header->granule_position;
+            if (!s->ogg_granule_found) {
+                s->ogg.first_granule_position = (long long)header->granule_position;
+                s->ogg_granule_found = 1;
+                if (s->ogg.codec == AUDIO_CODEC_OPUS && !(header->header_type & 1)) {
+                    memcpy(s->ogg_lacing, p, header->page_segments);
+                    s->ogg_lacing_index = 0;
+                    s->ogg_packet_pos = data_pos;
+                    s->ogg_page_samples = 0;
+                    stream_opus_next_toc(s);
+                    return;
+                }
+            }
+        }
+        stream_expect(s, STREAM_OGG_PAGE, s->ogg_page_end, OGG_PAGE_HEADER_SIZE);
+        return;
+    }
+    
+    size_t read_size = s->need;
+    if (read_size >= 23 && memcmp(p, "\x01vorbis", 7) == 0) {
+        s->ogg.codec = AUDIO_CODEC_VORBIS;
+        s->ogg.channels = p[11];
+        s->ogg.sample_rate = read_le32(p + 12);
+        s->ogg.bitstream_serial = header->bitstream_serial;
+    } else if (read_size >= 19 && memcmp(p, "OpusHead", 8) == 0) {
+        s->ogg.codec = AUDIO_CODEC_OPUS;
+        s->ogg.channels = p[9];
+        s->ogg.pre_skip = read_le16(p + 10);
+        s->ogg.sample_rate = 48000;
+        s->ogg.bitstream_serial = header->bitstream_serial;
+    }
+    stream_expect(s, STREAM_OGG_PAGE, s->ogg_page_end, OGG_PAGE_HEADER_SIZE);
+}
+
+// MP3帧循环：一次把手头数据里能看到的帧头都走完
+static void stream_mp3(StreamParser* s, const unsigned char* p, size_t avail, long long at) {
+    MP3FrameHeader* header = &s->mp3_header;
+    
+    if (s->state == STREAM_MP3_ID3) {
+        long long audio_start = 0;
+        if (memcmp(p, "ID3", 3) == 0) {
+            for (int i = 6; i < 10; i++) audio_start = audio_start * 128 + (p[i] & 0x7F);
+            audio_start += (p[5] & 0x10) ? 20 : 10;
+        }
+        s->mp3_first = 1;
+        stream_expect(s, STREAM_MP3_FRAME, audio_start, 4);
+        return;
+    }
+    
+    if (s->state == STREAM_MP3_FIRST) {
+        // 第一帧可能是Xing/Info/VBRI信息帧，有帧数就直接算出时长
+        BlockReader reader;
+        MP3VBRHeader vbr;
+        size_t got = avail < (size_t)header->frame_size ? avail : (size_t)header->frame_size;
+        reader_init_memory(&reader, p, got);
+        int has_vbr = read_vbr_header(&reader, 0, header, &vbr);
+        reader_close(&reader);
+        
+        if (has_vbr && vbr.frames > 0) {
+            s->ready = mp3_info_from_vbr(header, &vbr, &s->mp3);
+            stream_stop(s, !s->ready);
+            return;
+        }
+        if (has_vbr) mp3_set_gapless(&s->mp3, &vbr);
+        if (!has_vbr) {
+            s->mp3_first = 0;
+            s->mp3_first_bitrate = header->bitrate;
+            s->mp3.sample_rate = header->sample_rate;
+            s->mp3.layer = header->layer;
+            s->mp3.channels = header->channel_mode == 3 ? 1 : 2;
+            s->mp3.total_samples += get_mp3_samples_per_frame(header);
+            s->mp3_bytes += header->frame_size;
+        }
+        // 没有帧数字段的信息帧本身不含音频，跳过后照常走
+        stream_expect(s, STREAM_MP3_FRAME, at + header->frame_size, 4);
+        return;
+    }
+    
+    size_t i = 0;
+    while (i + 4 <= avail) {
+        if (!parse_mp3_header((unsigned char*)p + i, header)) {
+            // 不是有效的帧头，在手头数据里找下一个同步字；最后一个字节留着，同步字可能跨块
+            long long found = scan_sync(p + i + 1, avail - i - 1);
+            if (found < 0) {
+                stream_expect(s, STREAM_MP3_FRAME, at + (long long)avail - 1, 4);
+                return;
+            }
+            i += 1 + (size_t)found;
+            continue;
+        }
+        
+        if (s->mp3_first) {
+            stream_expect(s, STREAM_MP3_FIRST, at + (long long)i, (size_t)header->frame_size);
+            return;
+        }
+        
+        if (header->bitrate != s->mp3_first_bitrate) s->mp3.is_vbr = 1;
+        s->mp3.total_samples += get_mp3_samples_per_frame(header);
+        s->mp3_bytes += header->frame_size;
+        i += (size_t)header->frame_size;
+    }
+    stream_expect(s, STREAM_MP3_FRAME, at + (long long)i, 4);
+}
+
+// 处理从at开始的avail字节；只有收尾时avail才可能小于need
+static void stream_step(StreamParser* s, const unsigned char* p, size_t avail, long long at) {
+    if (s->state == STREAM_SNIFF) {
+        stream_sniff(s, p, avail);
+        return;
+    }
+    
+    if (avail < s->need) {
+        // 数据提前结束：MP3第一帧不完整也照样算一帧，FLAC末尾不足16字节里的帧头也要看，其他格式就此停下
+        if (s->state == STREAM_MP3_FIRST && avail >= 4) {
+            stream_mp3(s, p, avail, at);
+            if (s->state != STREAM_DONE) stream_stop(s, 0);
+            return;
+        }
+        if (s->state == STREAM_FLAC_FRAME) {
+            stream_flac(s, p, avail, at);
+            stream_stop(s, 0);
+            return;
+        }
+        stream_stop(s, 0);
+        return;
+    }
+    
+    switch (s->format) {
+        case AUDIO_FORMAT_WAV:  stream_wav(s, p, at); break;
+        case AUDIO_FORMAT_FLAC: stream_flac(s, p, avail, at); break;
+        case AUDIO_FORMAT_OGG:  stream_ogg(s, p, at); break;
+        case AUDIO_FORMAT_MP3:  stream_mp3(s, p, avail, at); break;
+        default:                stream_stop(s, 1); break;
+    }
+}
+
+// 缓冲区里的区间处理完后，保留下一步仍要的尾部（下一步的起点可能落在已收到的数据里）
+static void stream_step_buffered(StreamParser* s) {
+    long long at = s->skip_to;
+    size_t avail = s->buffered;
+    stream_step(s, s->buf, avail, at);
+    
+    long long end = at + (long long)avail;
+    if (s->state != STREAM_DONE && s->skip_to >= at && s->skip_to < end) {
+        size_t keep = (size_t)(end - s->skip_to);
+        memmove(s->buf, s->buf + (s->skip_to - at), keep);
+        s->buffered = keep;
+    } else {
+        s->buffered = 0;
+    }
+}
+
+static int stream_status(const StreamParser* s) {
+    if (s->ready) return STREAM_DURATION_READY;
+    if (s->failed) return STREAM_FAILED;
+    return STREAM_NEED_DATA;
+}
+
+static void stream_parser_init(StreamParser* s, const char* name_hint) {
+    memset(s, 0, offsetof(StreamParser, buf));
+    s->hint = format_from_extension(name_hint);
+    stream_expect(s, STREAM_SNIFF, 0, STREAM_BUFFER_SIZE);
+}
+
+StreamParser* create_stream_parser(const char* name_hint) {
+    StreamParser* s = (StreamParser*)ap_malloc(sizeof(StreamParser));
+    if (!s) return NULL;
+    
+    stream_parser_init(s, name_hint);
+    return s;
+}
+
+int feed_stream_parser(StreamParser* s, const void* data, size_t size) {
+    if (!s) return STREAM_FAILED;
+    if (!data && size > 0) return stream_status(s);
+    
+    const unsigned char* p = (const unsigned char*)data;
+    while (s->state != STREAM_DONE && !s->eof) {
+        if (s->buffered > 0) {
+            size_t want = s->need > s->buffered ? s->need - s->buffered : 0;
+            if (want > size) want = size;
+            memcpy(s->buf + s->buffered, p, want);
+            s->buffered += want;
+            s->pos += (long long)want;
+            p += want;
+            size -= want;
+            if (s->buffered < s->need) break;
+            stream_step_buffered(s);
+            continue;
+        }
+        if (size == 0) break;
+        
+        // 跳过不需要的字节
+        if (s->pos < s->skip_to) {
+            size_t n = s->skip_to - s->pos < (long long)size ? (size_t)(s->skip_to - s->pos) : size;
+            s->pos += (long long)n;
+            p += n;
+            size -= n;
+            continue;
+        }
+        
+        // 要的区间整个在这块数据里，直接解析，否则攒起来等下一块
+        if (size >= s->need && s->need > 0) {
+            stream_step(s, p, size, s->pos);
+            continue;
+        }
+        memcpy(s->buf, p, size);
+        s->buffered = size;
+        s->pos += (long long)size;
+        size = 0;
+    }
+    
+    s->pos += (long long)size;
+    return stream_status(s);
+}
+
+// 结束输入，按已收到的数据得出最终结果
+static int stream_result(StreamParser* s, AudioStreamInfo* out) {
+    memset(out, 0, sizeof(AudioStreamInfo));
+    out->struct_size = sizeof(AudioStreamInfo);
+    out->version = AUDIO_STREAM_INFO_VERSION;
+    
+    int ok = 0;
+    switch (s->format) {
+        case AUDIO_FORMAT_WAV:
+            if (s->ready) {
+                ok = 1;
+            } else if (s->eof && s->wav_data_offset > 0 && s->pos > s->wav_data_offset) {
+                unsigned int block_align = s->wav.channels * (s->wav.bits_per_sample / 8);
+                long long data_size = s->pos - s->wav_data_offset;
+                s->wav.data_size = data_size > 0xFFFFFFFFLL ? 0xFFFFFFFFu : (unsigned int)data_size;
+                s->wav.duration = (double)(data_size / block_align) / s->wav.sample_rate;
+                ok = s->wav.duration > 0;
+            }
+            if (ok) wav_to_stream_info(&s->wav, out);
+            break;
+        case AUDIO_FORMAT_FLAC: {
+            // 流式编码的FLAC按认出的末帧算，在副本上做，结果可以反复取
+            FLACInfo flac = s->flac;
+            if (s->ready) {
+                ok = 1;
+            } else if (s->eof && !s->failed && s->flac_chain.have_last) {
+                flac_set_last_frame(&flac, &s->flac_chain.last);
+                ok = 1;
+            }
+            if (ok) flac_to_stream_info(&flac, s->eof ? s->pos : 0, out);
+            break;
+        }
+        case AUDIO_FORMAT_OGG: {
+            // 当前节在副本上并进合计，结果可以反复取
+            OGGInfo ogg = s->ogg_chain;
+            OGGInfo link = s->ogg;
+            if (s->eof) {
+                if (s->ogg_granule_found && ogg_set_duration(&link)) ogg_add_link(&ogg, &link);
+                ogg.file_size = s->pos;
+                ok = ogg.link_count > 0 && ogg.duration > 0;
+            }
+            if (ok) ogg_to_stream_info(&ogg, out);
+            break;
+        }
+        case AUDIO_FORMAT_MP3: {
+            // 逐帧累计的是编码样本数，扣延迟和填充时在副本上做，结果可以反复取
+            MP3Info mp3 = s->mp3;
+            if (s->ready) {
+                ok = 1;
+            } else if (s->eof && mp3.sample_rate > 0 && mp3.total_samples > 0) {
+                mp3_set_total(&mp3, s->mp3.total_samples);
+                mp3.bitrate = mp3.is_vbr ? (int)(s->mp3_bytes * 8.0 / mp3.duration) : s->mp3_first_bitrate;
+                ok = 1;
+            }
+            if (ok) mp3_to_stream_info(&mp3, out);
+            break;
+        }
+        default:
+            out->error = s->state == STREAM_SNIFF ? AUDIO_ERR_PARSE : AUDIO_ERR_UNKNOWN_FORMAT;
+            return out->error;
+    }
+    
+    if (ok) set_duration_ns(out);
+    out->error = ok ? AUDIO_OK : AUDIO_ERR_PARSE;
+    return out->error;
+}
+
+int get_stream_parser_info(StreamParser* s, AudioStreamInfo* info) {
+    if (!s || !info) return AUDIO_ERR_INVALID_ARG;
+    
+    AudioStreamInfo result;
+    stream_result(s, &result);
+    return copy_stream_info(&result, info);
+}
+
+int finish_stream_parser(StreamParser* s, AudioStreamInfo* info) {
+    if (!s || !info) return AUDIO_ERR_INVALID_ARG;
+    
+    // 收尾：缓冲区里不足一步的数据也要处理（短文件的嗅探、截断的最后一帧）
+    s->eof = 1;
+    while (s->state != STREAM_DONE && s->buffered > 0) {
+        stream_step_buffered(s);
+    }
+    return get_stream_parser_info(s, info);
+}
+
+void free_stream_parser(StreamParser* s) {
+    ap_free(s);
+}
+
+// 还在写入的文件（边录边存）：句柄记住流解析器的状态，每次轮询只读上次之后追加的字节
+// 解析器不需要的区间（Ogg页数据、已经确定时长的WAV/FLAC）直接跳过不读；
+// 结果由解析器状态的一份拷贝收尾得出，真正的状态留到下次继续
+typedef struct {
+    BlockReader reader;
+    StreamParser parser;
+    char* name;                     // 文件被截短（重新录制）时从头再来，要用到格式提示
+    StreamParser snapshot;          // 每次轮询在这份副本上收尾，活的解析状态不动
+} GrowingFile;
+
+GrowingFile* open_growing_file(const char* filename) {
+    if (!filename) return NULL;
+    
+    GrowingFile* g = (GrowingFile*)ap_malloc(sizeof(GrowingFile));
+    if (!g) return NULL;
+    
+    size_t len = strlen(filename);
+    g->name = (char*)ap_malloc(len + 1);
+    if (!g->name || !reader_open_handle(&g->reader, filename, 0)) {
+        ap_free(g->name);
+        ap_free(g);
+        return NULL;
+    }
+    memcpy(g->name, filename, len + 1);
+    stream_parser_init(&g->parser, filename);
+    return g;
+}
+
+int poll_growing_file(GrowingFile* g, AudioStreamInfo* info) {
+    if (!g || !info) return AUDIO_ERR_INVALID_ARG;
+    
+    AP_STAT_BEGIN();
+    AP_STAT_PHASE(AP_PHASE_PARSE);
+    StreamParser* s = &g->parser;
+    long long size = reader_file_size(&g->reader);
+    if (size >= 0 && size < s->pos) stream_parser_init(s, g->name);
+    
+    while (s->pos < size && s->state != STREAM_DONE) {
+        // 要跳过一整块以上就直接挪过去，不读
+        if (s->buffered == 0 && s->skip_to - s->pos >= READER_BLOCK_SIZE) {
+            s->pos = s->skip_to < size ? s->skip_to : size;
+            continue;
+        }
+        
+        size_t len = size - s->pos < READER_BLOCK_SIZE ? (size_t)(size - s->pos) : READER_BLOCK_SIZE;
+        long long got = reader_read_at(&g->reader, s->pos, g->reader.block, len);
+        if (got <= 0) break;
+        feed_stream_parser(s, g->reader.block, (size_t)got);
+        
+        // 流式编码的FLAC不逐帧往后读，解析器到此为止（当作没得出结果），下面每次轮询按文件尾的末帧算
+        if (s->state == STREAM_FLAC_FRAME) stream_stop(s, 1);
+    }
+    if (s->state == STREAM_DONE && size > s->pos) s->pos = size;
+    
+    AudioStreamInfo result;
+    StreamParser* snapshot = &g->snapshot;
+    memcpy(snapshot, s, sizeof(StreamParser));
+    result.struct_size = sizeof(result);
+    finish_stream_parser(snapshot, &result);
+    
+    // WAV头里的data长度录制中往往还没写好，按文件当前长度重算；
+    // 头里的长度不超过已写入的数据时以头为准（录完后面还跟着别的块）
+    if (snapshot->format == AUDIO_FORMAT_WAV && snapshot->wav_data_offset > 0 && size > snapshot->wav_data_offset) {
+        WAVInfo* wav = &snapshot->wav;
+        unsigned int block_align = wav->channels * (wav->bits_per_sample / 8);
+        long long available = size - snapshot->wav_data_offset;
+        long long data_size = s->ready && wav->data_size <= available ? wav->data_size : available;
+        if (data_size > 0xFFFFFFFFLL) data_size = 0xFFFFFFFFLL;
+        wav->data_size = (unsigned int)data_size;
+        wav->duration = (double)(data_size / block_align) / wav->sample_rate;
+        memset(&result, 0, sizeof(result));
+        result.version = AUDIO_STREAM_INFO_VERSION;
+        wav_to_stream_info(wav, &result);
+        set_duration_ns(&result);
+        result.error = wav->duration > 0 ? AUDIO_OK : AUDIO_ERR_PARSE;
+    }
+    
+    // 边录边写的FLAC在STREAMINFO里总样本数为0，按当前文件尾的最后一帧算（末帧可能还没写完）；
+    // 轮询循环拿块缓冲当读缓冲用过，先作废再交给BlockReader
+    if (snapshot->format == AUDIO_FORMAT_FLAC && !s->ready && snapshot->flac.audio_offset > 0 && size > 0) {
+        FLACInfo* flac = &snapshot->flac;
+        g->reader.size = size;
+        g->reader.block_len = 0;
+        if (flac->total_samples == 0 &&
+            flac_tail_total(&g->reader, flac, FLAC_TAIL_WINDOW, FLAC_TAIL_MAX_WINDOW, NULL)) {
+            memset(&result, 0, sizeof(result));
+            result.version = AUDIO_STREAM_INFO_VERSION;
+            flac_to_stream_info(flac, size, &result);
+            set_duration_ns(&result);
+            result.error = AUDIO_OK;
+            AP_STAT_STRATEGY(AP_STRATEGY_FLAC_TAIL);
+        }
+    }
+    
+    AP_STAT_END();
+    return copy_stream_info(&result, info);
+}
+
+void close_growing_file(GrowingFile* g) {
+    if (!g) return;
+    reader_close(&g->reader);
+    ap_free(g->name);
+    ap_free(g);
+}
+
+// 统一的音频解析函数
+int get_audio_duration(const char* filename) {
+    if (!filename) return 0;
+    
+    BlockReader reader;
+    if (!reader_open_file(&reader, filename)) return 0;
+    
+    int duration = parse_audio_duration(&reader, format_from_extension(filename));
+    reader_close(&reader);
+    return duration;
+}
+
+// 单独的格式检测函数
+int get_ogg_duration(const char* filename) {
+    if (!filename) return 0;
+    
+    OGGInfo info;
+    if (parse_ogg_file(filename, &info)) {
+        return (int)info.duration;
+    }
+    return 0;
+}
+
+// 链式Ogg的逐节信息：写入前max_links节（每项link_size字节），返回总节数，可能大于max_links
+// 不是Ogg或解析失败返回0
+int get_ogg_links(const char* filename, AudioOggLink* links, int max_links, size_t link_size) {
+    if (!filename || max_links < 0 || (max_links > 0 && (!links || link_size == 0))) return 0;
+    
+    BlockReader reader;
+    if (!reader_open_file(&reader, filename)) return 0;
+    
+    OGGInfo info;
+    int count = parse_ogg_chain(&reader, &info, links, max_links, link_size);
+    reader_close(&reader);
+    return count;
+}
+
+int get_flac_duration(const char* filename) {
+    if (!filename) return 0;
+    
+    FLACInfo info;
+    if (parse_flac_file(filename, &info)) {
+        return (int)info.duration;
+    }
+    return 0;
+}
+
+int get_mp3_duration_export(const char* filename) {
+    return get_mp3_duration_optimized(filename);
+}
+
+int get_wav_duration(const char* filename) {
+    if (!filename) return 0;
+    
+    WAVInfo info;
+    if (parse_wav_file(filename, &info)) {
+        return (int)info.duration;
+    }
+    return 0;
+}
+
+// 内存版本：与文件版本共用同一套解析核心
+int get_wav_duration_from_buffer(const void* data, size_t size) {
+    if (!data) return 0;
+    
+    BlockReader reader;
+    reader_init_memory(&reader, data, size);
+    
+    WAVInfo info;
+    int duration = parse_wav(&reader, &info) ? (int)info.duration : 0;
+    reader_close(&reader);
+    return duration;
+}
+
+int get_flac_duration_from_buffer(const void* data, size_t size) {
+    if (!data) return 0;
+    
+    BlockReader reader;
+    reader_init_memory(&reader, data, size);
+    
+    FLACInfo info;
+    int duration = parse_flac(&reader, &info, 0) ? (int)info.duration : 0;
+    reader_close(&reader);
+    return duration;
+}
+
+int get_ogg_duration_from_buffer(const void* data, size_t size) {
+    if (!data) return 0;
+    
+    BlockReader reader;
+    reader_init_memory(&reader, data, size);
+    
+    OGGInfo info;
+    int duration = parse_ogg(&reader, &info) ? (int)info.duration : 0;
+    reader_close(&reader);
+    return duration;
+}
+
+int get_mp3_duration_from_buffer(const void* data, size_t size) {
+    if (!data) return 0;
+    
+    BlockReader reader;
+    reader_init_memory(&reader, data, size);
+    
+    MP3Info info;
+    int duration = parse_mp3(&reader, &info) ? (int)info.duration : 0;
+    reader_close(&reader);
+    return duration;
+}
+
+int get_audio_duration_from_buffer(const void* data, size_t size) {
+    if (!data) return 0;
+    
+    BlockReader reader;
+    reader_init_memory(&reader, data, size);
+    int duration = parse_audio_duration(&reader, AUDIO_FORMAT_UNKNOWN);
+    reader_close(&reader);
+    return duration;
+}
+
+// 跳转索引：可播放样本号 → 字节偏移，按固定间隔取点；播放器跳转时查一次表、读一次盘
+// sidecar文件可能在服务端生成、客户端使用，固定小端序：
+//   "APSI"、u8版本、u8标志、u16编码、u32采样率、u32点数、u64总样本数、u64建索引时的文件大小，共32字节头
+//   之后每点两个LEB128变长整数：与上一点的样本号差、字节偏移差（两者都不减小），一个点通常四五个字节
+#define SEEK_INDEX_MAGIC       "APSI"
+#define SEEK_INDEX_VERSION     1
+#define SEEK_INDEX_HEADER_SIZE 32
+#define SEEK_INDEX_DEFAULT_MS  1000
+#define SEEK_INDEX_MAX_POINTS  (1 << 24)     // 载入时的上限，坏文件不至于让我们分配几个GB
+#define SEEK_INDEX_APPROXIMATE 0x1           // 标志：点是按目录换算的，不一定落在帧起点上
+#define OPUS_PREROLL_SAMPLES   3840          // Opus跳转后先解码丢弃80ms再出声（RFC 7845 4.6节）
+
+typedef struct {
+    int codec;
+    int flags;                      // SEEK_INDEX_*
+    unsigned int sample_rate;
+    unsigned long long total_samples;
+    long long file_size;
+    unsigned long long interval;    // 相邻两点至少隔这么多样本
+    AudioSeekPoint* points;
+    int count;
+    int capacity;
+} SeekIndex;
+
+static SeekIndex* seek_index_create(int codec, unsigned int sample_rate, long long file_size, unsigned int interval_ms) {
+    SeekIndex* index = (SeekIndex*)ap_calloc(1, sizeof(SeekIndex));
+    if (!index) return NULL;
+    
+    if (interval_ms == 0) interval_ms = SEEK_INDEX_DEFAULT_MS;
+    index->codec = codec;
+    index->sample_rate = sample_rate;
+    index->file_size = file_size;
+    index->interval = (unsigned long long)sample_rate * interval_ms / 1000;
+    if (index->interval == 0) index->interval = 1;
+    return index;
+}
+
+void free_seek_index(SeekIndex* index) {
+    if (!index) return;
+    ap_free(index->points);
+    ap_free(index);
+}
+
+// force为0时离上一点不到一个间隔就不加；同一样本号上只留最后一个点。内存不足返回0
+static int seek_index_add(SeekIndex* index, unsigned long long sample, long long offset, int force) {
+    if (index->count > 0) {
+        AudioSeekPoint* last = &index->points[index->count - 1];
+        if (sample < last->sample || offset < last->offset) return 1;
+        if (!force && sample - last->sample < index->interval) return 1;
+        if (sample == last->sample) {
+            last->offset = offset;
+            return 1;
+        }
+    }
+    
+    if (index->count == index->capacity) {
+        int capacity = index->capacity ? index->capacity * 2 : 256;
+        AudioSeekPoint* points = (AudioSeekPoint*)ap_realloc(index->points, (size_t)capacity * sizeof(AudioSeekPoint));
+        if (!points) return 0;
+        index->points = points;
+        index->capacity = capacity;
+    }
+    
+    index->points[index->count].sample = sample;
+    index->points[index->count].offset = offset;
+    index->count++;
+    return 1;
+}
+
+static unsigned long long seek_scale(unsigned long long samples, unsigned int from_rate, unsigned int to_rate) {
+    if (from_rate == to_rate || from_rate == 0) return samples;
+    return samples * to_rate / from_rate;
+}
+
+// 一遍顺序读页头（只跳过数据不读）：每节的BOS页组起点一个点，节内只在不以续包开头的音频页上取点，
+// 这种页上第一个包的起始样本正好是同一流上一页的granule。链式文件各节依次往后接，按第一节的采样率折算
+static SeekIndex* ogg_seek_index(BlockReader* r, unsigned int interval_ms) {
+    OGGLink link;
+    if (!read_ogg_link_head(r, 0, &link)) return NULL;
+    
+    SeekIndex* index = seek_index_create(link.info.codec, link.info.sample_rate, r->size, interval_ms);
+    if (!index) return NULL;
+    
+    OGGPageHeader header;
+    long long data_size;
+    unsigned long long base = 0;    // 前面各节的样本数
+    for (;;) {
+        OGGInfo* info = &link.info;
+        long long origin = -1;      // 本节第一个可播放样本的granule，见到第一个音频页才知道
+        long long previous = 0;     // 本节音频流上一页的granule
+        long long pos = link.data_start;
+        int ok = seek_index_add(index, base, link.begin, 1);
+        int next_link = 0;
+        
+        while (ok && read_ogg_page_header(r, pos, &header, &data_size)) {
+            if (header.header_type & 2) {
+                next_link = 1;
+                break;
+            }
+            if (header.bitstream_serial == info->bitstream_serial &&
+                header.granule_position > 0 && header.granule_position != OGG_GRANULE_NONE) {
+                if (origin < 0) {
+                    info->first_granule_position = (long long)header.granule_position;
+                    if (info->codec == AUDIO_CODEC_OPUS) ogg_set_start(info, opus_page_samples(r, pos, &header));
+                    origin = info->start_granule + info->pre_skip;
+                } else if (!(header.header_type & 1) && previous > origin) {
+                    unsigned long long sample = seek_scale((unsigned long long)(previous - origin),
+                                                           info->sample_rate, index->sample_rate);
+                    ok = seek_index_add(index, base + sample, pos, 0);
+                }
+                previous = (long long)header.granule_position;
+            }
+            pos += ogg_page_size(&header, data_size);
+        }
+        
+        if (!ok) {
+            free_seek_index(index);
+            return NULL;
+        }
+        if (origin >= 0 && previous > origin) {
+            base += seek_scale((unsigned long long)(previous - origin), info->sample_rate, index->sample_rate);
+        }
+        if (!next_link || !read_ogg_link_head(r, pos, &link)) break;
+    }
+    
+    index->total_samples = base;
+    return index;
+}
+
+// interval_ms为相邻两点的最小间隔，0取默认的1秒；不是Ogg或内存不足返回NULL
+SeekIndex* build_ogg_seek_index(const char* filename, unsigned int interval_ms) {
+    if (!filename) return NULL;
+    
+    BlockReader reader;
+    if (!reader_open_file(&reader, filename)) return NULL;
+    
+    SeekIndex* index = ogg_seek_index(&reader, interval_ms);
+    reader_close(&reader);
+    return index;
+}
+
+// Xing目录：第i项是播放到i%时的位置占总字节数的比例（乘256），从信息帧起算；只是近似位置
+static int mp3_xing_seek_points(SeekIndex* index, long long frame_pos, const MP3VBRHeader* vbr,
+                                long long coded_samples, int leading, long long file_size) {
+    long long bytes = vbr->bytes > 0 ? (long long)vbr->bytes : file_size - frame_pos;
+    for (int i = 0; i < 100; i++) {
+        long long coded = coded_samples * i / 100;
+        if (i > 0 && coded < leading) continue;
+        unsigned long long sample = i > 0 ? (unsigned long long)(coded - leading) : 0;
+        long long offset = frame_pos + bytes * vbr->toc[i] / 256;
+        if (!seek_index_add(index, sample, offset, 0)) return 0;
+    }
+    return 1;
+}
+
+// VBRI目录紧跟在头后面：每项是相邻frames_per_entry帧的字节数（除以scale存放），从信息帧之后起算
+static int mp3_vbri_seek_points(BlockReader* r, SeekIndex* index, long long frame_pos, const MP3FrameHeader* header,
+                                int leading, int* found) {
+    *found = 0;
+    const unsigned char* vbri = reader_span(r, frame_pos + 36, 26);
+    if (!vbri) return 1;
+    
+    unsigned int entries = (vbri[18] << 8) | vbri[19];
+    unsigned int scale = (vbri[20] << 8) | vbri[21];
+    unsigned int entry_size = (vbri[22] << 8) | vbri[23];
+    unsigned int frames_per_entry = (vbri[24] << 8) | vbri[25];
+    if (entries == 0 || entry_size == 0 || entry_size > 4 || frames_per_entry == 0) return 1;
+    
+    const unsigned char* table = reader_span(r, frame_pos + 36 + 26, (size_t)entries * entry_size);
+    if (!table) return 1;
+    
+    long long samples_per_entry = (long long)frames_per_entry * get_mp3_samples_per_frame(header);
+    long long offset = frame_pos + header->frame_size;
+    if (!seek_index_add(index, 0, offset, 1)) return 0;
+    for (unsigned int i = 0; i < entries; i++) {
+        unsigned long long size = 0;
+        for (unsigned int b = 0; b < entry_size; b++) size = (size << 8) | table[i * entry_size + b];
+        offset += (long long)(size * (scale ? scale : 1));
+        
+        long long coded = samples_per_entry * (i + 1);
+        if (coded >= leading && offset < r->size &&
+            !seek_index_add(index, (unsigned long long)(coded - leading), offset, 0)) {
+            return 0;
+        }
+    }
+    *found = 1;
+    return 1;
+}
+
+// 从第一帧开始一帧帧往后走（遇到坏帧头就找下一个同步字，和解析时长的逐帧遍历一致），每隔一个间隔记下帧起点
+// 第一帧是Xing/VBRI信息帧时：有目录且没要求精确就直接换算目录，否则跳过信息帧照常走
+static SeekIndex* mp3_seek_index(BlockReader* r, unsigned int interval_ms, int flags) {
+    long long file_size = r->size;
+    long long pos = skip_id3v2_tag(r);
+    
+    SeekIndex* index = NULL;
+    MP3Info info;
+    memset(&info, 0, sizeof(MP3Info));
+    long long coded = 0;
+    int samples_per_frame = 0;
+    int ok = 1;
+    
+    while (ok && pos < file_size - 4) {
+        const unsigned char* buffer = reader_span(r, pos, 4);
+        if (!buffer) break;
+        
+        MP3FrameHeader header;
+        if (!parse_mp3_header((unsigned char*)buffer, &header)) {
+            pos = find_mp3_sync(r, pos + 1, file_size);
+            if (pos < 0) break;
+            continue;
+        }
+        
+        if (!index) {
+            int codec = AUDIO_CODEC_MP3;
+            if (header.layer == 1) codec = AUDIO_CODEC_MP1;
+            else if (header.layer == 2) codec = AUDIO_CODEC_MP2;
+            index = seek_index_create(codec, (unsigned int)header.sample_rate, file_size, interval_ms);
+            if (!index) return NULL;
+            info.sample_rate = header.sample_rate;
+            samples_per_frame = get_mp3_samples_per_frame(&header);
+            
+            MP3VBRHeader vbr;
+            if (read_vbr_header(r, pos, &header, &vbr)) {
+                mp3_set_gapless(&info, &vbr);
+                if (!(flags & AUDIO_SEEK_EXACT) && vbr.frames > 0) {
+                    long long total = (long long)vbr.frames * samples_per_frame;
+                    int found = 0;
+                    if (vbr.type == MP3_VBR_VBRI) {
+                        ok = mp3_vbri_seek_points(r, index, pos, &header, info.leading_samples, &found);
+                    } else if (vbr.has_toc) {
+                        ok = mp3_xing_seek_points(index, pos, &vbr, total, info.leading_samples, file_size);
+                        found = 1;
+                    }
+                    if (ok && found) {
+                        mp3_set_total(&info, total);
+                        index->flags |= SEEK_INDEX_APPROXIMATE;
+                        index->total_samples = (unsigned long long)info.total_samples;
+                        return index;
+                    }
+                    index->count = 0;
+                }
+                // 信息帧本身不含音频
+                pos += header.frame_size;
+                continue;
+            }
+        }
+        
+        if (coded == 0) {
+            ok = seek_index_add(index, 0, pos, 1);
+        } else if (coded >= info.leading_samples) {
+            ok = seek_index_add(index, (unsigned long long)(coded - info.leading_samples), pos, 0);
+        }
+        coded += samples_per_frame;
+        pos += header.frame_size;
+    }
+    
+    if (!ok || !index || coded == 0) {
+        free_seek_index(index);
+        return NULL;
+    }
+    mp3_set_total(&info, coded);
+    index->total_samples = (unsigned long long)info.total_samples;
+    return index;
+}
+
+// flags含AUDIO_SEEK_EXACT时不用Xing/VBRI目录，整段逐帧建表；不是MPEG音频或内存不足返回NULL
+SeekIndex* build_mp3_seek_index(const char* filename, unsigned int interval_ms, int flags) {
+    if (!filename) return NULL;
+    
+    BlockReader reader;
+    if (!reader_open_file(&reader, filename)) return NULL;
+    
+    SeekIndex* index = mp3_seek_index(&reader, interval_ms, flags);
+    reader_close(&reader);
+    return index;
+}
+
+// 找最后一个不晚于目标时刻的点（Opus先让出预滚的80ms），返回它的字节偏移，失败返回-1
+// point非空时写入该点，播放器从这里解码后丢掉目标之前的样本
+long long lookup_seek_index(const SeekIndex* index, double seconds, AudioSeekPoint* point) {
+    if (!index || index->count == 0 || !(seconds >= 0)) return -1;
+    
+    double position = seconds * index->sample_rate;
+    unsigned long long target = position < (double)index->total_samples ?
+                                (unsigned long long)position : index->total_samples;
+    if (index->codec == AUDIO_CODEC_OPUS) target = target > OPUS_PREROLL_SAMPLES ? target - OPUS_PREROLL_SAMPLES : 0;
+    
+    int lo = 0;
+    int hi = index->count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (index->points[mid].sample <= target) lo = mid;
+        else hi = mid - 1;
+    }
+    
+    if (point) *point = index->points[lo];
+    return index->points[lo].offset;
+}
+
+int get_seek_index_info(const SeekIndex* index, AudioSeekIndexInfo* info) {
+    if (!index || !info) return AUDIO_ERR_INVALID_ARG;
+    
+    AudioSeekIndexInfo result;
+    memset(&result, 0, sizeof(result));
+    result.struct_size = sizeof(result);
+    result.version = AUDIO_SEEK_INDEX_INFO_VERSION;
+    result.codec = index->codec;
+    result.sample_rate = index->sample_rate;
+    result.point_count = (unsigned int)index->count;
+    result.exact = !(index->flags & SEEK_INDEX_APPROXIMATE);
+    result.total_samples = index->total_samples;
+    result.file_size = index->file_size;
+    result.duration = index->sample_rate ? (double)index->total_samples / index->sample_rate : 0;
+    
+    size_t size = info->struct_size;
+    if (size < sizeof(unsigned int) * 2) return AUDIO_ERR_INVALID_ARG;
+    if (size > sizeof(AudioSeekIndexInfo)) size = sizeof(AudioSeekIndexInfo);
+    memcpy((char*)info + sizeof(unsigned int), (const char*)&result + sizeof(unsigned int),
+           size - sizeof(unsigned int));
+    return AUDIO_OK;
+}
+
+// 写入前max_points个点（每项point_size字节），返回总点数
+int get_seek_index_points(const SeekIndex* index, AudioSeekPoint* points, int max_points, size_t point_size) {
+    if (!index || max_points < 0 || (max_points > 0 && (!points || point_size == 0))) return 0;
+    
+    int count = index->count < max_points ? index->count : max_points;
+    size_t copy = point_size < sizeof(AudioSeekPoint) ? point_size : sizeof(AudioSeekPoint);
+    for (int i = 0; i < count; i++) {
+        memcpy((char*)points + (size_t)i * point_size, &index->points[i], copy);
+    }
+    return index->count;
+}
+
+static void seek_put_le(unsigned char* p, unsigned long long value, int bytes) {
+    for (int i = 0; i < bytes; i++) p[i] = (unsigned char)(value >> (8 * i));
+}
+
+static unsigned long long seek_get_le(const unsigned char* p, int bytes) {
+    unsigned long long value = 0;
+    for (int i = 0; i < bytes; i++) value |= (unsigned long long)p[i] << (8 * i);
+    return value;
+}
+
+// p为NULL时只算长度
+static size_t seek_put_varint(unsigned char* p, unsigned long long value) {
+    size_t len = 0;
+    do {
+        unsigned char byte = (unsigned char)(value & 0x7F);
+        value >>= 7;
+        if (p) p[len] = byte | (value ? 0x80 : 0);
+        len++;
+    } while (value);
+    return len;
+}
+
+// 越界或超过64位返回0
+static size_t seek_get_varint(const unsigned char* p, size_t avail, unsigned long long* value) {
+    unsigned long long result = 0;
+    for (size_t i = 0; i < avail && i < 10; i++) {
+        unsigned long long bits = p[i] & 0x7F;
+        if (i == 9 && bits > 1) return 0;
+        result |= bits << (7 * i);
+        if (!(p[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// 返回序列化后的字节数；buffer为NULL或size不够时只算长度不写
+size_t serialize_seek_index(const SeekIndex* index, void* buffer, size_t size) {
+    if (!index) return 0;
+    
+    size_t total = SEEK_INDEX_HEADER_SIZE;
+    for (int i = 0; i < index->count; i++) {
+        const AudioSeekPoint* prev = i > 0 ? &index->points[i - 1] : NULL;
+        total += seek_put_varint(NULL, index->points[i].sample - (prev ? prev->sample : 0));
+        total += seek_put_varint(NULL, (unsigned long long)(index->points[i].offset - (prev ? prev->offset : 0)));
+    }
+    if (!buffer || size < total) return total;
+    
+    unsigned char* p = (unsigned char*)buffer;
+    memcpy(p, SEEK_INDEX_MAGIC, 4);
+    p[4] = SEEK_INDEX_VERSION;
+    p[5] = (unsigned char)index->flags;
+    seek_put_le(p + 6, (unsigned int)index->codec, 2);
+    seek_put_le(p + 8, index->sample_rate, 4);
+    seek_put_le(p + 12, (unsigned int)index->count, 4);
+    seek_put_le(p + 16, index->total_samples, 8);
+    seek_put_le(p + 24, (unsigned long long)index->file_size, 8);
+    
+    size_t at = SEEK_INDEX_HEADER_SIZE;
+    for (int i = 0; i < index->count; i++) {
+        const AudioSeekPoint* prev = i > 0 ? &index->points[i - 1] : NULL;
+        at += seek_put_varint(p + at, index->points[i].sample - (prev ? prev->sample : 0));
+        at += seek_put_varint(p + at, (unsigned long long)(index->points[i].offset - (prev ? prev->offset : 0)));
+    }
+    return total;
+}
+
+// 头部、点数、长度任何一处对不上都当坏文件，返回NULL；点必须落在头里声明的总样本数和文件大小之内
+SeekIndex* load_seek_index_from_buffer(const void* data, size_t size) {
+    const unsigned char* p = (const unsigned char*)data;
+    if (!p || size < SEEK_INDEX_HEADER_SIZE || memcmp(p, SEEK_INDEX_MAGIC, 4) != 0 ||
+        p[4] != SEEK_INDEX_VERSION) {
+        return NULL;
+    }
+    
+    unsigned int sample_rate = (unsigned int)seek_get_le(p + 8, 4);
+    unsigned int count = (unsigned int)seek_get_le(p + 12, 4);
+    unsigned long long total_samples = seek_get_le(p + 16, 8);
+    unsigned long long file_size = seek_get_le(p + 24, 8);
+    if (sample_rate == 0 || count > SEEK_INDEX_MAX_POINTS || count > (size - SEEK_INDEX_HEADER_SIZE) / 2 ||
+        (file_size >> 62) != 0) {
+        return NULL;
+    }
+    
+    SeekIndex* index = seek_index_create((int)seek_get_le(p + 6, 2), sample_rate, (long long)file_size, 0);
+    if (!index) return NULL;
+    index->flags = p[5];
+    index->total_samples = total_samples;
+    if (count > 0) {
+        index->points = (AudioSeekPoint*)ap_malloc((size_t)count * sizeof(AudioSeekPoint));
+        if (!index->points) {
+            free_seek_index(index);
+            return NULL;
+        }
+        index->capacity = (int)count;
+    }
+    
+    size_t at = SEEK_INDEX_HEADER_SIZE;
+    unsigned long long sample = 0;
+    unsigned long long offset = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned long long sample_delta;
+        unsigned long long offset_delta;
+        size_t len = seek_get_varint(p + at, size - at, &sample_delta);
+        if (len == 0) break;
+        at += len;
+        len = seek_get_varint(p + at, size - at, &offset_delta);
+        if (len == 0 || sample_delta > total_samples - sample || offset_delta > file_size - offset) break;
+        at += len;
+        
+        sample += sample_delta;
+        offset += offset_delta;
+        index->points[i].sample = sample;
+        index->points[i].offset = (long long)offset;
+        index->count++;
+    }
+    
+    if ((unsigned int)index->count != count || at != size) {
+        free_seek_index(index);
+        return NULL;
+    }
+    return index;
+}
+
+// 先写临时文件再改名，和时长缓存的索引文件一样
+int save_seek_index(const SeekIndex* index, const char* path) {
+    if (!index || !path) return 0;
+    
+    size_t size = serialize_seek_index(index, NULL, 0);
+    unsigned char* data = (unsigned char*)ap_malloc(size);
+    size_t path_len = strlen(path);
+    char* tmp_path = (char*)ap_malloc(path_len + 5);
+    int ok = data && tmp_path;
+    
+    FILE* file = NULL;
+    if (ok) {
+        serialize_seek_index(index, data, size);
+        memcpy(tmp_path, path, path_len);
+        memcpy(tmp_path + path_len, ".tmp", 5);
+        file = fopen(tmp_path, "wb");
+        ok = file != NULL;
+    }
+    if (ok) {
+        ok = fwrite(data, 1, size, file) == size;
+        if (fclose(file) != 0) ok = 0;
+#ifdef _WIN32
+        if (ok) ok = MoveFileExA(tmp_path, path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        if (ok) ok = rename(tmp_path, path) == 0;
+#endif
+        if (!ok) remove(tmp_path);
+    }
+    
+    ap_free(tmp_path);
+    ap_free(data);
+    return ok;
+}
+
+SeekIndex* load_seek_index(const char* path) {
+    if (!path) return NULL;
+    
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    
+    // 每点最多20字节，再长就不是我们写的
+    unsigned char* data = NULL;
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+    if (size >= SEEK_INDEX_HEADER_SIZE && size <= SEEK_INDEX_HEADER_SIZE + 20L * SEEK_INDEX_MAX_POINTS &&
+        fseek(file, 0, SEEK_SET) == 0) {
+        data = (unsigned char*)ap_malloc((size_t)size);
+    }
+    
+    SeekIndex* index = NULL;
+    if (data && fread(data, 1, (size_t)size, file) == (size_t)size) {
+        index = load_seek_index_from_buffer(data, (size_t)size);
+    }
+    
+    fclose(file);
+    ap_free(data);
+    return index;
+}
+
+// 时长缓存：内存哈希表 + 磁盘索引文件，按(设备, inode, 大小, 修改时间)识别文件
+// （Windows上设备和inode换成完整路径的哈希，查一次只取属性、不打开文件）
+// 文件一改，大小或修改时间就对不上，自动当作未命中重新解析；只记解析成功的时长，打不开、读失败不记
+// 启用/停用不要与解析调用并发，查找和插入由缓存锁保护
+#define CACHE_MAGIC       0x43445041u   // "APDC"
+#define CACHE_VERSION     2             // 2：Windows的键改为路径哈希，旧索引里可能有失败记下的0
+#define CACHE_MIN_CAPACITY 1024
+
+typedef struct {
+    unsigned long long device;
+    unsigned long long inode;
+    long long size;
+    long long mtime_ns;
+} FileKey;
+
+typedef struct {
+    FileKey key;
+    int duration;
+    int used;
+} CacheEntry;
+
+typedef struct {
+    int enabled;
+    ap_mutex lock;
+    CacheEntry* entries;
+    size_t capacity;      // 2的幂
+    size_t count;
+    char* index_path;     // NULL 表示只在内存中缓存
+    int dirty;
+    long long hits;
+    long long misses;
+} DurationCache;
+
+static DurationCache duration_cache;
+
+static int get_file_key(const char* filename, FileKey* key) {
+#ifdef _WIN32
+    // 卷序列号和文件号要打开文件才拿得到，命中也得开一次句柄；改用完整路径的哈希（不分大小写、
+    // 两种斜杠算一样），大小和修改时间用GetFileAttributesExA按路径取
+    char full[1024];
+    DWORD len = GetFullPathNameA(filename, sizeof(full), full, NULL);
+    if (len == 0 || len >= sizeof(full)) return 0;
+    
+    WIN32_FILE_ATTRIBUTE_DATA fa;
+    if (!GetFileAttributesExA(full, GetFileExInfoStandard, &fa)) return 0;
+    
+    unsigned long long hash = 0xCBF29CE484222325ULL;  // FNV-1a
+    for (DWORD i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)full[i];
+        if (c == '/') c = '\\';
+        else if (c >= 'A' && c <= 'Z') c = (unsigned char)(c - 'A' + 'a');
+        hash = (hash ^ c) * 0x100000001B3ULL;
+    }
+    
+    key->device = 0;
+    key->inode = hash;
+    key->size = (long long)(((unsigned long long)fa.nFileSizeHigh << 32) | fa.nFileSizeLow);
+    // FILETIME单位是100纳秒
+    key->mtime_ns = (long long)((((unsigned long long)fa.ftLastWriteTime.dwHighDateTime << 32) |
+                                 fa.ftLastWriteTime.dwLowDateTime) * 100);
+#else
+    struct stat st;
+    if (stat(filename, &st) != 0) return 0;
+    
+    key->device = (unsigned long long)st.st_dev;
+    key->inode = (unsigned long long)st.st_ino;
+    key->size = (long long)st.st_size;
+#ifdef __APPLE__
+    key->mtime_ns = (long long)st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+    key->mtime_ns = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+#endif
+    return 1;
+}
+
+static size_t cache_hash(const FileKey* key) {
+    unsigned long long h = key->device * 0x9E3779B97F4A7C15ULL ^ key->inode;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return (size_t)h;
+}
+
+// 按(设备, inode)找槽位：返回同一文件的槽或第一个空槽
+static CacheEntry* cache_slot(CacheEntry* entries, size_t capacity, const FileKey* key) {
+    size_t i = cache_hash(key) & (capacity - 1);
+    while (entries[i].used) {
+        if (entries[i].key.device == key->device && entries[i].key.inode == key->inode) break;
+        i = (i + 1) & (capacity - 1);
+    }
+    return &entries[i];
+}
+
+static int cache_grow(DurationCache* cache) {
+    size_t capacity = cache->capacity ? cache->capacity * 2 : CACHE_MIN_CAPACITY;
+    CacheEntry* entries = (CacheEntry*)ap_calloc(capacity, sizeof(CacheEntry));
+    if (!entries) return 0;
+    
+    for (size_t i = 0; i < cache->capacity; i++) {
+        if (cache->entries[i].used) {
+            *cache_slot(entries, capacity, &cache->entries[i].key) = cache->entries[i];
+        }
+    }
+    
+    ap_free(cache->entries);
+    cache->entries = entries;
+    cache->capacity = capacity;
+    return 1;
+}
+
+// 调用方需持有缓存锁；同一文件的旧记录被直接覆盖
+static void cache_store(DurationCache* cache, const FileKey* key, int duration) {
+    if ((cache->count + 1) * 10 > cache->capacity * 7 && !cache_grow(cache)) return;
+    
+    CacheEntry* slot = cache_slot(cache->entries, cache->capacity, key);
+    if (!slot->used) {
+        slot->used = 1;
+        cache->count++;
+    }
+    slot->key = *key;
+    slot->duration = duration;
+    cache->dirty = 1;
+}
+
+// 索引文件：magic, version, count，随后是count条定长记录
+static void cache_load_index(DurationCache* cache) {
+    FILE* file = fopen(cache->index_path, "rb");
+    if (!file) return;
+    
+    unsigned int header[3];
+    if (fread(header, sizeof(unsigned int), 3, file) == 3 &&
+        header[0] == CACHE_MAGIC && header[1] == CACHE_VERSION) {
+        for (unsigned int i = 0; i < header[2]; i++) {
+            CacheEntry entry;
+            if (fread(&entry.key, sizeof(FileKey), 1, file) != 1 ||
+                fread(&entry.duration, sizeof(int), 1, file) != 1) {
+                break;
+            }
+            if (entry.duration > 0) cache_store(cache, &entry.key, entry.duration);
+        }
+    }
+    
+    fclose(file);
+    cache->dirty = 0;
+}
+
+// 先写临时文件再改名，写到一半崩溃也不会留下坏索引
+static int cache_save_index(DurationCache* cache) {
+    if (!cache->index_path) return 1;
+    
+    size_t path_len = strlen(cache->index_path);
+    char* tmp_path = (char*)ap_malloc(path_len + 5);
+    if (!tmp_path) return 0;
+    memcpy(tmp_path, cache->index_path, path_len);
+    memcpy(tmp_path + path_len, ".tmp", 5);
+    
+    FILE* file = fopen(tmp_path, "wb");
+    if (!file) {
+        ap_free(tmp_path);
+        return 0;
+    }
+    
+    unsigned int header[3] = { CACHE_MAGIC, CACHE_VERSION, (unsigned int)cache->count };
+    int ok = fwrite(header, sizeof(unsigned int), 3, file) == 3;
+    
+    for (size_t i = 0; ok && i < cache->capacity; i++) {
+        if (!cache->entries[i].used) continue;
+        ok = fwrite(&cache->entries[i].key, sizeof(FileKey), 1, file) == 1 &&
+             fwrite(&cache->entries[i].duration, sizeof(int), 1, file) == 1;
+    }
+    
+    if (fclose(file) != 0) ok = 0;
+
+#ifdef _WIN32
+    if (ok) ok = MoveFileExA(tmp_path, cache->index_path, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    if (ok) ok = rename(tmp_path, cache->index_path) == 0;
+#endif
+    if (!ok) remove(tmp_path);
+    
+    ap_free(tmp_path);
+    if (ok) cache->dirty = 0;
+    return ok;
+}
+
+int enable_duration_cache(const char* index_path) {
+    DurationCache* cache = &duration_cache;
+    if (cache->enabled) return 1;
+    
+    memset(cache, 0, sizeof(DurationCache));
+    if (!cache_grow(cache)) return 0;
+    
+    if (index_path) {
+        size_t len = strlen(index_path);
+        cache->index_path = (char*)ap_malloc(len + 1);
+        if (!cache->index_path) {
+            ap_free(cache->entries);
+            return 0;
+        }
+        memcpy(cache->index_path, index_path, len + 1);
+        cache_load_index(cache);
+    }
+    
+    ap_mutex_init(&cache->lock);
+    cache->enabled = 1;
+    return 1;
+}
+
+int save_duration_cache(void) {
+    DurationCache* cache = &duration_cache;
+    if (!cache->enabled) return 0;
+    
+    ap_mutex_lock(&cache->lock);
+    int ok = cache->dirty ? cache_save_index(cache) : 1;
+    ap_mutex_unlock(&cache->lock);
+    return ok;
+}
+
+void disable_duration_cache(void) {
+    DurationCache* cache = &duration_cache;
+    if (!cache->enabled) return;
+    
+    if (cache->dirty) cache_save_index(cache);
+    
+    cache->enabled = 0;
+    ap_mutex_destroy(&cache->lock);
+    ap_free(cache->entries);
+    ap_free(cache->index_path);
+    memset(cache, 0, sizeof(DurationCache));
+}
+
+void get_duration_cache_stats(long long* hits, long long* misses, long long* entries) {
+    DurationCache* cache = &duration_cache;
+    long long h = 0, m = 0, n = 0;
+    
+    if (cache->enabled) {
+        ap_mutex_lock(&cache->lock);
+        h = cache->hits;
+        m = cache->misses;
+        n = (long long)cache->count;
+        ap_mutex_unlock(&cache->lock);
+    }
+    
+    if (hits) *hits = h;
+    if (misses) *misses = m;
+    if (entries) *entries = n;
+}
+
+// 查缓存：命中返回1；*have_key表示key已取到，解析完可以用cache_remember记下结果
+static int cache_lookup(const char* filename, FileKey* key, int* have_key, int* duration) {
+    DurationCache* cache = &duration_cache;
+    *have_key = 0;
+    if (!cache->enabled || !filename || !get_file_key(filename, key)) return 0;
+    *have_key = 1;
+    
+    int hit = 0;
+    ap_mutex_lock(&cache->lock);
+    CacheEntry* slot = cache_slot(cache->entries, cache->capacity, key);
+    if (slot->used && slot->key.size == key->size && slot->key.mtime_ns == key->mtime_ns) {
+        *duration = slot->duration;
+        cache->hits++;
+        hit = 1;
+    } else {
+        cache->misses++;
+    }
+    ap_mutex_unlock(&cache->lock);
+    
+    if (hit) {
+        AP_STAT_BEGIN();
+        AP_STAT_STRATEGY(AP_STRATEGY_CACHE);
+        AP_STAT_END();
+    }
+    return hit;
+}
+
+// 失败（0）不记：打不开、I/O出错可能是暂时的，改权限、重新挂载都不改大小和修改时间，记下就一直返回0
+static void cache_remember(const FileKey* key, int duration) {
+    DurationCache* cache = &duration_cache;
+    if (!cache->enabled || duration <= 0) return;
+    
+    ap_mutex_lock(&cache->lock);
+    cache_store(cache, key, duration);
+    ap_mutex_unlock(&cache->lock);
+}
+
+// 缓存开着就先查表，未命中再解析并记下结果
+static int cached_audio_duration(const char* filename) {
+    FileKey key;
+    int have_key;
+    int duration;
+    if (cache_lookup(filename, &key, &have_key, &duration)) return duration;
+    
+    duration = get_audio_duration(filename);
+    if (have_key) cache_remember(&key, duration);
+    return duration;
+}
+
+// 解析上下文只在一个线程上用；热起来之后文件解析路径上没有堆分配
+ParserContext* create_parser_context(void) {
+    ParserContext* context = (ParserContext*)ap_malloc(sizeof(ParserContext));
+    if (!context) return NULL;
+    
+    context->block = (unsigned char*)ap_malloc(READER_BLOCK_SIZE);
+    if (!context->block) {
+        ap_free(context);
+        return NULL;
+    }
+    context->block_busy = 0;
+    return context;
+}
+
+void free_parser_context(ParserContext* context) {
+    if (!context) return;
+    ap_free(context->block);
+    ap_free(context);
+}
+
+// 把上下文挂到当前线程上，返回原先挂着的，用完交给context_leave恢复
+static ParserContext* context_enter(ParserContext* context) {
+    ParserContext* previous = ap_active_context;
+    ap_active_context = context;
+    return previous;
+}
+
+static void context_leave(ParserContext* previous) {
+    ap_active_context = previous;
+}
+
+// context为NULL时与不带上下文的版本相同
+int get_audio_duration_with_context(ParserContext* context, const char* filename) {
+    ParserContext* previous = context_enter(context);
+    int duration = cached_audio_duration(filename);
+    context_leave(previous);
+    return duration;
+}
+
+int get_audio_stream_info_with_context(ParserContext* context, const char* filename, AudioStreamInfo* info) {
+    ParserContext* previous = context_enter(context);
+    int error = get_audio_stream_info(filename, info);
+    context_leave(previous);
+    return error;
+}
+
+// 批量解析：每个线程持有一段下标区间，做完自己的就去别的线程那里偷一半
+// 解析函数本身没有共享的可写状态，可以并发调用
+typedef struct {
+    ap_mutex lock;
+    int next;   // 下一个待处理的下标
+    int end;    // 区间末尾（不含）
+} BatchQueue;
+
+typedef struct {
+    const char* const* filenames;
+    int* durations;
+    BatchQueue* queues;
+    int num_queues;
+} BatchJob;
+
+typedef struct {
+    BatchJob* job;
+    int id;
+    int succeeded;
+} BatchWorker;
+
+static int batch_take(BatchQueue* queue, int* index) {
+    int ok = 0;
+    ap_mutex_lock(&queue->lock);
+    if (queue->next < queue->end) {
+        *index = queue->next++;
+        ok = 1;
+    }
+    ap_mutex_unlock(&queue->lock);
+    return ok;
+}
+
+static int batch_steal(BatchJob* job, int thief) {
+    for (int i = 1; i < job->num_queues; i++) {
+        BatchQueue* victim = &job->queues[(thief + i) % job->num_queues];
+        int begin = 0, end = 0;
+        
+        ap_mutex_lock(&victim->lock);
+        int remaining = victim->end - victim->next;
+        if (remaining > 0) {
+            // 偷走后一半（至少一个）
+            begin = victim->end - (remaining + 1) / 2;
+            end = victim->end;
+            victim->end = begin;
+        }
+        ap_mutex_unlock(&victim->lock);
+        
+        if (end > begin) {
+            BatchQueue* own = &job->queues[thief];
+            ap_mutex_lock(&own->lock);
+            own->next = begin;
+            own->end = end;
+            ap_mutex_unlock(&own->lock);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static AP_THREAD_PROC batch_worker(void* arg) {
+    BatchWorker* worker = (BatchWorker*)arg;
+    BatchJob* job = worker->job;
+    int index;
+    
+    // 每个工作线程一个上下文，逐个文件解析时不再争用分配器
+    ParserContext* context = create_parser_context();
+    ParserContext* previous = context_enter(context);
+    for (;;) {
+        while (batch_take(&job->queues[worker->id], &index)) {
+            int duration = cached_audio_duration(job->filenames[index]);
+            job->durations[index] = duration;
+            if (duration > 0) worker->succeeded++;
+        }
+        if (!batch_steal(job, worker->id)) break;
+    }
+    context_leave(previous);
+    free_parser_context(context);
+    return AP_THREAD_EXIT;
+}
+
+int get_audio_duration_batch(const char* const* filenames, int count, int* durations, int num_threads) {
+    if (!filenames || !durations || count <= 0) return 0;
+    
+    if (num_threads <= 0) num_threads = ap_cpu_count();
+    if (num_threads > AP_MAX_THREADS) num_threads = AP_MAX_THREADS;
+    if (num_threads > count) num_threads = count;
+    
+    BatchQueue* queues = (BatchQueue*)ap_malloc(sizeof(BatchQueue) * num_threads);
+    BatchWorker* workers = (BatchWorker*)ap_malloc(sizeof(BatchWorker) * num_threads);
+    ap_thread* threads = (ap_thread*)ap_malloc(sizeof(ap_thread) * num_threads);
+    if (!queues || !workers || !threads) {
+        ap_free(queues);
+        ap_free(workers);
+        ap_free(threads);
+        return 0;
+    }
+    
+    BatchJob job;
+    job.filenames = filenames;
+    job.durations = durations;
+    job.queues = queues;
+    job.num_queues = num_threads;
+    
+    // 初始按均分切区间
+    for (int i = 0; i < num_threads; i++) {
+        ap_mutex_init(&queues[i].lock);
+        queues[i].next = (int)((long long)count * i / num_threads);
+        queues[i].end = (int)((long long)count * (i + 1) / num_threads);
+        workers[i].job = &job;
+        workers[i].id = i;
+        workers[i].succeeded = 0;
+    }
+    
+    // 调用线程自己当0号工作线程；起不来的线程的区间会被其他线程偷走
+    int started = 0;
+    for (int i = 1; i < num_threads; i++) {
+        if (ap_thread_start(&threads[started], batch_worker, &workers[i])) {
+            started++;
+        }
+    }
+    batch_worker(&workers[0]);
+    for (int i = 0; i < started; i++) {
+        ap_thread_join(threads[i]);
+    }
+    
+    int succeeded = 0;
+    for (int i = 0; i < num_threads; i++) {
+        succeeded += workers[i].succeeded;
+        ap_mutex_destroy(&queues[i].lock);
+    }
+    
+    ap_free(queues);
+    ap_free(workers);
+    ap_free(threads);
+    return succeeded;
+}
+
+// 单线程深队列批量解析，面向机械盘和网络文件系统上的冷数据
+// 同时打开queue_depth个文件，把头部（Ogg和未知格式再加尾部）的读请求一起提交出去；
+// 读完的文件在预取区间上以非阻塞方式解析，缺数据就补交一个读请求，完成后从头重跑
+// 补读几轮还不够（比如没有Xing头的VBR MP3要整段遍历）就改回同步读
+// 定义AP_USE_IO_URING且内核支持时走io_uring，否则用posix_fadvise(WILLNEED)让内核提前读
+#define PREFETCH_DEFAULT_DEPTH 128
+#define PREFETCH_MAX_DEPTH     1024
+
+typedef struct {
+    int index;          // 文件下标，-1表示空闲
+    int hint;
+    int have_key;
+    int pending;        // 还没完成的读请求数
+    FileKey key;
+    BlockReader reader;
+} PrefetchSlot;
+
+#ifdef AP_USE_IO_URING
+// 不依赖liburing，直接用系统调用和共享环
+typedef struct {
+    int fd;
+    unsigned int sq_tail;         // 本地的提交队列尾，提交时才写回共享环
+    unsigned int* sq_head_ptr;
+    unsigned int* sq_tail_ptr;
+    unsigned int* sq_mask;
+    unsigned int* sq_entries;
+    unsigned int* sq_array;
+    unsigned int* cq_head;
+    unsigned int* cq_tail;
+    unsigned int* cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_ring;
+    void* cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} ApRing;
+
+static void ap_ring_free(ApRing* ring) {
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+    ring->fd = -1;
+}
+
+static int ap_ring_init(ApRing* ring, unsigned int entries) {
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(ApRing));
+    memset(&params, 0, sizeof(params));
+    
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) return 0;
+    
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    int single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+    
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        ap_ring_free(ring);
+        return 0;
+    }
+    if (single_mmap) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            ap_ring_free(ring);
+            return 0;
+        }
+    }
+    ring->sqes = (struct io_uring_sqe*)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        ap_ring_free(ring);
+        return 0;
+    }
+    
+    unsigned char* sq = (unsigned char*)ring->sq_ring;
+    unsigned char* cq = (unsigned char*)ring->cq_ring;
+    ring->sq_head_ptr = (unsigned int*)(sq + params.sq_off.head);
+    ring->sq_tail_ptr = (unsigned int*)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned int*)(sq + params.sq_off.ring_mask);
+    ring->sq_entries = (unsigned int*)(sq + params.sq_off.ring_entries);
+    ring->sq_array = (unsigned int*)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned int*)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned int*)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned int*)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    ring->sq_tail = *ring->sq_tail_ptr;
+    return 1;
+}
+
+// 提交队列满时返回NULL
+static struct io_uring_sqe* ap_ring_get_sqe(ApRing* ring) {
+    unsigned int head = __atomic_load_n(ring->sq_head_ptr, __ATOMIC_ACQUIRE);
+    if (ring->sq_tail - head >= *ring->sq_entries) return NULL;
+    
+    unsigned int index = ring->sq_tail & *ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    ring->sq_array[index] = index;
+    ring->sq_tail++;
+    return sqe;
+}
+
+// 提交所有未提交的请求，并等到至少wait_nr个完成
+static int ap_ring_submit_and_wait(ApRing* ring, unsigned int wait_nr) {
+    __atomic_store_n(ring->sq_tail_ptr, ring->sq_tail, __ATOMIC_RELEASE);
+    
+    for (;;) {
+        unsigned int to_submit = ring->sq_tail - __atomic_load_n(ring->sq_head_ptr, __ATOMIC_ACQUIRE);
+        long ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr,
+                           wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (ret >= 0) return 1;
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY) return 0;
+    }
+}
+#endif
+
+typedef struct {
+    const char* const* filenames;
+    int* durations;
+    int count;
+    int next;             // 下一个要打开的文件下标
+    int succeeded;
+    PrefetchSlot* slots;
+    int depth;
+    int use_ring;
+#ifdef AP_USE_IO_URING
+    ApRing ring;
+#endif
+} PrefetchJob;
+
+static void prefetch_finish(PrefetchJob* job, PrefetchSlot* slot, int duration) {
+    job->durations[slot->index] = duration;
+    if (duration > 0) job->succeeded++;
+    if (slot->have_key) cache_remember(&slot->key, duration);
+    
+    reader_close(&slot->reader);
+    slot->index = -1;
+}
+
+// 请求读[offset, offset + len)：io_uring下读进一个新的预取区间，否则只提示内核预读
+static void prefetch_request(PrefetchJob* job, int slot_id, long long offset, size_t len) {
+    BlockReader* r = &job->slots[slot_id].reader;
+    if (offset + (long long)len > r->size) len = (size_t)(r->size - offset);
+    if (len == 0) return;
+
+#ifdef AP_USE_IO_URING
+    if (job->use_ring) {
+        if (r->segment_count >= READER_MAX_SEGMENTS) return;
+        
+        ReaderSegment* segment = &r->segments[r->segment_count];
+        segment->data = (unsigned char*)ap_malloc(len);
+        if (!segment->data) return;
+        segment->offset = offset;
+        segment->len = 0;  // 读完才生效
+        
+        struct io_uring_sqe* sqe = ap_ring_get_sqe(&job->ring);
+        if (!sqe) {
+            // 队列满时退化为同步读
+            long long got = reader_read_at(r, offset, segment->data, len);
+            segment->len = got > 0 ? (size_t)got : 0;
+            r->segment_count++;
+            return;
+        }
+        
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = r->fd;
+        sqe->addr = (unsigned long long)(size_t)segment->data;
+        sqe->len = (unsigned int)len;
+        sqe->off = (unsigned long long)offset;
+        sqe->user_data = ((unsigned long long)slot_id << 8) | (unsigned int)r->segment_count;
+        r->segment_count++;
+        job->slots[slot_id].pending++;
+        return;
+    }
+#endif
+
+#if !defined(_WIN32) && defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(r->fd, (off_t)offset, (off_t)len, POSIX_FADV_WILLNEED);
+#else
+    (void)job;
+    (void)slot_id;
+#endif
+}
+
+// 读请求都完成后推进一步：在预取区间上试解析，缺数据就补读，补不了就同步解析
+static void prefetch_advance(PrefetchJob* job, int slot_id) {
+    PrefetchSlot* slot = &job->slots[slot_id];
+    BlockReader* r = &slot->reader;
+    
+    if (job->use_ring && r->backend == READER_FILE) {
+        r->nonblocking = 1;
+        r->miss_len = 0;
+        int duration = parse_audio_duration(r, slot->hint);
+        r->nonblocking = 0;
+        
+        if (r->miss_len == 0) {
+            prefetch_finish(job, slot, duration);
+            return;
+        }
+        if (r->segment_count < READER_MAX_SEGMENTS) {
+            long long start = r->miss_offset & ~(long long)(READER_ALIGN - 1);
+            size_t len = READER_BLOCK_SIZE;
+            if ((size_t)(r->miss_offset - start) + r->miss_len > len) {
+                len = (size_t)(r->miss_offset - start) + r->miss_len;
+            }
+            prefetch_request(job, slot_id, start, len);
+            if (slot->pending > 0) return;
+        }
+
+#ifdef AP_USE_IO_URING
+        // 改回同步顺序读，恢复内核预读
+        posix_fadvise(r->fd, 0, 0, POSIX_FADV_NORMAL);
+#endif
+    }
+    
+    prefetch_finish(job, slot, parse_audio_duration(r, slot->hint));
+}
+
+// 给空闲槽位换上下一个需要解析的文件，缓存命中和打不开的文件直接出结果；没有文件了返回0
+static int prefetch_open(PrefetchJob* job, int slot_id) {
+    PrefetchSlot* slot = &job->slots[slot_id];
+    
+    while (job->next < job->count) {
+        int index = job->next++;
+        const char* filename = job->filenames[index];
+        int duration;
+        
+        if (cache_lookup(filename, &slot->key, &slot->have_key, &duration)) {
+            job->durations[index] = duration;
+            if (duration > 0) job->succeeded++;
+            continue;
+        }
+        if (!filename || !reader_open_file(&slot->reader, filename)) {
+            job->durations[index] = 0;
+            continue;
+        }
+        
+        slot->index = index;
+        slot->hint = format_from_extension(filename);
+        slot->pending = 0;
+        if (slot->reader.backend != READER_FILE) return 1;
+
+#ifdef AP_USE_IO_URING
+        // 要读哪几段由这里决定，关掉内核预读免得每个小请求都被放大
+        if (job->use_ring) posix_fadvise(slot->reader.fd, 0, 0, POSIX_FADV_RANDOM);
+#endif
+
+        // 头部一块；Ogg的时长在尾部，格式未知时也一并取尾部
+        long long size = slot->reader.size;
+        if (size <= 2 * READER_BLOCK_SIZE) {
+            prefetch_request(job, slot_id, 0, (size_t)size);
+        } else {
+            prefetch_request(job, slot_id, 0, READER_BLOCK_SIZE);
+            if (slot->hint == AUDIO_FORMAT_OGG || slot->hint == AUDIO_FORMAT_UNKNOWN) {
+                prefetch_request(job, slot_id, size - READER_BLOCK_SIZE, READER_BLOCK_SIZE);
+            }
+        }
+        return 1;
+    }
+    return 0;
+}
+
+// 没有io_uring时按先进先出轮转槽位：每个槽位解析完立刻换下一个文件并提示预读
+static void prefetch_run_sync(PrefetchJob* job) {
+    int active = 0;
+    for (int i = 0; i < job->depth; i++) {
+        if (!prefetch_open(job, i)) break;
+        active++;
+    }
+    
+    for (int i = 0; active > 0; i = (i + 1) % job->depth) {
+        if (job->slots[i].index < 0) continue;
+        prefetch_advance(job, i);
+        if (!prefetch_open(job, i)) active--;
+    }
+}
+
+#ifdef AP_USE_IO_URING
+// 让槽位一直有读请求在路上：没请求了就推进解析，解析完就换下一个文件；文件都分完了返回0
+static int prefetch_keep_busy(PrefetchJob* job, int slot_id) {
+    PrefetchSlot* slot = &job->slots[slot_id];
+    while (slot->index < 0 || slot->pending == 0) {
+        if (slot->index >= 0) {
+            prefetch_advance(job, slot_id);
+        } else if (!prefetch_open(job, slot_id)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void prefetch_run_ring(PrefetchJob* job) {
+    int active = 0;
+    for (int i = 0; i < job->depth; i++) {
+        if (prefetch_keep_busy(job, i)) active++;
+    }
+    
+    while (active > 0) {
+        if (!ap_ring_submit_and_wait(&job->ring, 1)) break;
+        
+        unsigned int head = *job->ring.cq_head;
+        unsigned int tail = __atomic_load_n(job->ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            struct io_uring_cqe* cqe = &job->ring.cqes[head & *job->ring.cq_mask];
+            int slot_id = (int)(cqe->user_data >> 8);
+            PrefetchSlot* slot = &job->slots[slot_id];
+            ReaderSegment* segment = &slot->reader.segments[cqe->user_data & 0xFF];
+            segment->len = cqe->res > 0 ? (size_t)cqe->res : 0;
+            AP_STAT_READ(segment->offset, (long long)segment->len);
+            
+            if (--slot->pending > 0) continue;
+            if (!prefetch_keep_busy(job, slot_id)) active--;
+        }
+        __atomic_store_n(job->ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+    
+    // 环出错时改走同步读；还在路上的请求可能仍会写预取缓冲区，只能放弃这些缓冲区不释放
+    if (active > 0) {
+        job->use_ring = 0;
+        for (int i = 0; i < job->depth; i++) {
+            if (job->slots[i].index < 0) continue;
+            job->slots[i].reader.segment_count = 0;
+            job->slots[i].pending = 0;
+            prefetch_advance(job, i);
+        }
+        prefetch_run_sync(job);
+    }
+}
+#endif
+
+int get_audio_duration_batch_queued(const char* const* filenames, int count, int* durations, int queue_depth) {
+    if (!filenames || !durations || count <= 0) return 0;
+    
+    if (queue_depth <= 0) queue_depth = PREFETCH_DEFAULT_DEPTH;
+    if (queue_depth > PREFETCH_MAX_DEPTH) queue_depth = PREFETCH_MAX_DEPTH;
+    if (queue_depth > count) queue_depth = count;
+    
+    PrefetchJob job;
+    memset(&job, 0, sizeof(PrefetchJob));
+    job.filenames = filenames;
+    job.durations = durations;
+    job.count = count;
+    job.depth = queue_depth;
+    job.slots = (PrefetchSlot*)ap_calloc((size_t)queue_depth, sizeof(PrefetchSlot));
+    if (!job.slots) return 0;
+    for (int i = 0; i < queue_depth; i++) {
+        job.slots[i].index = -1;
+    }
+
+#ifdef AP_USE_IO_URING
+    // 每个文件同时最多两个读请求在路上
+    unsigned int entries = 1;
+    while (entries < (unsigned int)queue_depth * 2) entries *= 2;
+    job.use_ring = ap_ring_init(&job.ring, entries);
+    if (job.use_ring) {
+        prefetch_run_ring(&job);
+        ap_ring_free(&job.ring);
+    } else {
+        prefetch_run_sync(&job);
+    }
+#else
+    prefetch_run_sync(&job);
+#endif
+
+    ap_free(job.slots);
+    return job.succeeded;
+}
+
+// 目录扫描：多个线程共用一个任务栈，任务是目录（列出后把子项压栈）或文件（嗅探并解析）
+// 栈空且没有任务在做时结束；结果的顺序不固定
+#define SCAN_ALL_FILES 0x1      // 不按扩展名预筛，每个普通文件都嗅探一遍
+
+#ifdef _WIN32
+#define SCAN_PATH_SEP '\\'
+#else
+#define SCAN_PATH_SEP '/'
+#endif
+
+typedef void (*ScanCallback)(const char* path, int duration, void* user);
+
+typedef struct {
+    char* path;
+    int is_dir;
+} ScanTask;
+
+typedef struct {
+    ap_mutex lock;
+    ap_cond wake;
+    ScanTask* tasks;
+    int task_count;
+    int task_capacity;
+    int outstanding;          // 已入栈但还没做完的任务数
+    int flags;
+    int root_ok;
+    
+    ap_mutex result_lock;     // 回调和结果缓冲区都在这把锁下，回调不会并发
+    ScanCallback callback;
+    void* user;
+    unsigned char* buffer;    // 打包结果，callback为NULL时使用
+    size_t buffer_size;
+    size_t buffer_capacity;
+    int found;
+    long long total_seconds;
+    int failed;               // 内存不足
+} ScanJob;
+
+// 接管path；调用方不持有任务锁
+static void scan_push(ScanJob* job, char* path, int is_dir) {
+    ap_mutex_lock(&job->lock);
+    if (job->task_count == job->task_capacity) {
+        int capacity = job->task_capacity ? job->task_capacity * 2 : 256;
+        ScanTask* tasks = (ScanTask*)ap_realloc(job->tasks, sizeof(ScanTask) * (size_t)capacity);
+        if (!tasks) {
+            job->failed = 1;
+            ap_mutex_unlock(&job->lock);
+            ap_free(path);
+            return;
+        }
+        job->tasks = tasks;
+        job->task_capacity = capacity;
+    }
+    job->tasks[job->task_count].path = path;
+    job->tasks[job->task_count].is_dir = is_dir;
+    job->task_count++;
+    job->outstanding++;
+    ap_cond_broadcast(&job->wake);
+    ap_mutex_unlock(&job->lock);
+}
+
+static char* scan_join(const char* dir, const char* name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char* path = (char*)ap_malloc(dir_len + name_len + 2);
+    if (!path) return NULL;
+    
+    memcpy(path, dir, dir_len);
+    if (dir_len > 0 && dir[dir_len - 1] != '/' && dir[dir_len - 1] != SCAN_PATH_SEP) {
+        path[dir_len++] = SCAN_PATH_SEP;
+    }
+    memcpy(path + dir_len, name, name_len + 1);
+    return path;
+}
+
+static void scan_add_entry(ScanJob* job, const char* dir, const char* name, int is_dir) {
+    if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) return;
+    if (!is_dir && !(job->flags & SCAN_ALL_FILES) && format_from_extension(name) == AUDIO_FORMAT_UNKNOWN) return;
+    
+    char* path = scan_join(dir, name);
+    if (path) scan_push(job, path, is_dir);
+}
+
+// 列出一个目录；符号链接指向的目录不进入，免得绕圈
+static int scan_list_directory(ScanJob* job, const char* dir) {
+#ifdef _WIN32
+    char* pattern = scan_join(dir, "*");
+    if (!pattern) return 0;
+    
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(pattern, &entry);
+    ap_free(pattern);
+    if (find == INVALID_HANDLE_VALUE) return 0;
+    
+    do {
+        if (entry.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT &&
+            entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            continue;
+        }
+        scan_add_entry(job, dir, entry.cFileName, (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0);
+    } while (FindNextFileA(find, &entry));
+    
+    FindClose(find);
+    return 1;
+#else
+    DIR* d = opendir(dir);
+    if (!d) return 0;
+    
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        int is_dir = 0;
+        int is_file = 0;
+#ifdef DT_DIR
+        // 大多数文件系统直接给出类型，不用逐个stat
+        if (entry->d_type == DT_DIR) is_dir = 1;
+        else if (entry->d_type == DT_REG) is_file = 1;
+        else if (entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK) continue;
+#endif
+        if (!is_dir && !is_file) {
+            struct stat st;
+            if (fstatat(dirfd(d), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode)) {
+                is_dir = 1;
+            } else if (fstatat(dirfd(d), entry->d_name, &st, 0) == 0 && S_ISREG(st.st_mode)) {
+                is_file = 1;
+            }
+        }
+        if (is_dir || is_file) scan_add_entry(job, dir, entry->d_name, is_dir);
+    }
+    
+    closedir(d);
+    return 1;
+#endif
+}
+
+// 打包记录：int32时长、int32路径长度、路径和结尾的0，按4字节对齐
+static int scan_append_record(ScanJob* job, const char* path, int duration) {
+    int path_len = (int)strlen(path);
+    size_t record_size = (8 + (size_t)path_len + 1 + 3) & ~(size_t)3;
+    
+    if (job->buffer_size + record_size > job->buffer_capacity) {
+        size_t capacity = job->buffer_capacity ? job->buffer_capacity * 2 : 65536;
+        while (capacity < job->buffer_size + record_size) capacity *= 2;
+        unsigned char* buffer = (unsigned char*)ap_realloc(job->buffer, capacity);
+        if (!buffer) return 0;
+        job->buffer = buffer;
+        job->buffer_capacity = capacity;
+    }
+    
+    unsigned char* record = job->buffer + job->buffer_size;
+    memset(record, 0, record_size);
+    memcpy(record, &duration, 4);
+    memcpy(record + 4, &path_len, 4);
+    memcpy(record + 8, path, (size_t)path_len);
+    job->buffer_size += record_size;
+    return 1;
+}
+
+// 嗅探不出格式的文件不算音频，不上报；缓存只记成功的时长，未命中的要重新解析一次才知道是不是音频
+static void scan_parse_file(ScanJob* job, const char* path) {
+    FileKey key;
+    int have_key;
+    int duration;
+    
+    if (!cache_lookup(path, &key, &have_key, &duration)) {
+        BlockReader reader;
+        if (!reader_open_file(&reader, path)) return;
+        
+        AudioStreamInfo info;
+        int error = parse_audio_info(&reader, format_from_extension(path), 1, &info);
+        reader_close(&reader);
+        
+        duration = error == AUDIO_OK ? (int)info.duration : 0;
+        if (have_key) cache_remember(&key, duration);
+        if (error == AUDIO_ERR_UNKNOWN_FORMAT) return;
+    }
+    
+    ap_mutex_lock(&job->result_lock);
+    job->found++;
+    job->total_seconds += duration;
+    if (job->callback) {
+        job->callback(path, duration, job->user);
+    } else if (!scan_append_record(job, path, duration)) {
+        job->failed = 1;
+    }
+    ap_mutex_unlock(&job->result_lock);
+}
+
+static AP_THREAD_PROC scan_worker(void* arg) {
+    ScanJob* job = (ScanJob*)arg;
+    ParserContext* context = create_parser_context();
+    ParserContext* previous = context_enter(context);
+    
+    ap_mutex_lock(&job->lock);
+    for (;;) {
+        while (job->task_count == 0 && job->outstanding > 0) {
+            ap_cond_wait(&job->wake, &job->lock);
+        }
+        if (job->task_count == 0) break;
+        
+        // 后进先出，深度优先，栈不会太大
+        ScanTask task = job->tasks[--job->task_count];
+        ap_mutex_unlock(&job->lock);
+        
+        if (task.is_dir) {
+            scan_list_directory(job, task.path);
+        } else {
+            scan_parse_file(job, task.path);
+        }
+        ap_free(task.path);
+        
+        ap_mutex_lock(&job->lock);
+        if (--job->outstanding == 0) ap_cond_broadcast(&job->wake);
+    }
+    ap_mutex_unlock(&job->lock);
+    context_leave(previous);
+    free_parser_context(context);
+    return AP_THREAD_EXIT;
+}
+
+static int scan_directory(const char* root, int flags, int num_threads, ScanCallback callback, void* user,
+                          ScanJob* job) {
+    memset(job, 0, sizeof(ScanJob));
+    if (!root) return 0;
+    
+    job->flags = flags;
+    job->callback = callback;
+    job->user = user;
+    ap_mutex_init(&job->lock);
+    ap_mutex_init(&job->result_lock);
+    ap_cond_init(&job->wake);
+    
+    // 根目录先在调用线程里列出来，打不开直接报错
+    size_t root_len = strlen(root);
+    char* root_copy = (char*)ap_malloc(root_len + 1);
+    if (root_copy) {
+        memcpy(root_copy, root, root_len + 1);
+        job->root_ok = scan_list_directory(job, root_copy);
+        ap_free(root_copy);
+    }
+    
+    if (job->root_ok) {
+        if (num_threads <= 0) num_threads = ap_cpu_count();
+        if (num_threads > AP_MAX_THREADS) num_threads = AP_MAX_THREADS;
+        
+        ap_thread threads[AP_MAX_THREADS];
+        int started = 0;
+        for (int i = 1; i < num_threads; i++) {
+            if (ap_thread_start(&threads[started], scan_worker, job)) started++;
+        }
+        scan_worker(job);
+        for (int i = 0; i < started; i++) {
+            ap_thread_join(threads[i]);
+        }
+    }
+    
+    ap_free(job->tasks);
+    ap_cond_destroy(&job->wake);
+    ap_mutex_destroy(&job->result_lock);
+    ap_mutex_destroy(&job->lock);
+    return job->root_ok && !job->failed;
+}
+
+// 返回找到的音频文件数，根目录打不开或内存不足返回-1
+int scan_directory_callback(const char* root, int flags, int num_threads, ScanCallback callback, void* user,
+                            long long* total_seconds) {
+    if (!callback) return -1;
+    
+    ScanJob job;
+    int ok = scan_directory(root, flags, num_threads, callback, user, &job);
+    if (total_seconds) *total_seconds = job.total_seconds;
+    return ok ? job.found : -1;
+}
+
+int scan_directory_packed(const char* root, int flags, int num_threads, void** buffer, size_t* size,
+                          long long* total_seconds) {
+    if (!buffer || !size) return -1;
+    *buffer = NULL;
+    *size = 0;
+    
+    ScanJob job;
+    int ok = scan_directory(root, flags, num_threads, NULL, NULL, &job);
+    if (total_seconds) *total_seconds = job.total_seconds;
+    if (!ok) {
+        ap_free(job.buffer);
+        return -1;
+    }
+    
+    *buffer = job.buffer;
+    *size = job.buffer_size;
+    return job.found;
+}
+
+// 异步解析：提交后立即返回，内部线程池解析，结果放进无锁完成队列并通过eventfd通知
+// 事件循环监听GetAsyncParserFd返回的描述符，可读时调用drain_async_results取走结果
+// 提交了但还没取走的请求数不超过容量，完成队列因此永远不会满，工作线程从不阻塞在入队上
+#define ASYNC_DEFAULT_CAPACITY 1024
+
+typedef struct {
+    unsigned long long tag;
+    AudioStreamInfo info;
+} AudioAsyncResult;
+
+typedef struct {
+    unsigned long long tag;
+    char* path;                     // NULL表示解析内存缓冲区
+    const void* data;
+    size_t size;
+} AsyncJob;
+
+// 有界多生产者多消费者环形队列：每格的序号表示它当前可写（== 位置）还是可读（== 位置 + 1）
+typedef struct {
+    long long sequence;
+    AudioAsyncResult result;
+} AsyncCell;
+
+typedef struct {
+    int num_threads;
+    long long capacity;             // 2的幂
+    
+    ap_mutex lock;                  // 保护提交队列和closing
+    ap_cond wake;
+    AsyncJob* jobs;
+    long long job_head;
+    long long job_count;
+    int closing;
+    long long in_flight;            // 已提交未取走的请求数，原子访问
+    
+    AsyncCell* cells;
+    long long enqueue_pos;
+    long long dequeue_pos;
+
+#ifdef _WIN32
+    HANDLE event;                   // 手动复位事件，有结果时置位
+#else
+    int notify_fd;                  // Linux上是eventfd，其他系统是管道读端
+    int notify_write_fd;            // 管道写端；eventfd时与notify_fd相同
+#endif
+    ap_thread threads[AP_MAX_THREADS];
+} AsyncParser;
+
+static int async_enqueue(AsyncParser* p, const AudioAsyncResult* result) {
+    long long pos = ap_atomic_load64(&p->enqueue_pos);
+    for (;;) {
+        AsyncCell* cell = &p->cells[pos & (p->capacity - 1)];
+        long long diff = ap_atomic_load_acquire64(&cell->sequence) - pos;
+        if (diff == 0) {
+            if (ap_atomic_cas64(&p->enqueue_pos, pos, pos + 1)) {
+                cell->result = *result;
+                ap_atomic_store_release64(&cell->sequence, pos + 1);
+                return 1;
+            }
+            pos = ap_atomic_load64(&p->enqueue_pos);
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = ap_atomic_load64(&p->enqueue_pos);
+        }
+    }
+}
+
+static int async_dequeue(AsyncParser* p, AudioAsyncResult* result) {
+    long long pos = ap_atomic_load64(&p->dequeue_pos);
+    for (;;) {
+        AsyncCell* cell = &p->cells[pos & (p->capacity - 1)];
+        long long diff = ap_atomic_load_acquire64(&cell->sequence) - (pos + 1);
+        if (diff == 0) {
+            if (ap_atomic_cas64(&p->dequeue_pos, pos, pos + 1)) {
+                *result = cell->result;
+                ap_atomic_store_release64(&cell->sequence, pos + p->capacity);
+                return 1;
+            }
+            pos = ap_atomic_load64(&p->dequeue_pos);
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = ap_atomic_load64(&p->dequeue_pos);
+        }
+    }
+}
+
+// 先入队再通知：消费方先清通知再出队，结果不会漏掉，最多多醒一次
+static void async_notify(AsyncParser* p) {
+#ifdef _WIN32
+    SetEvent(p->event);
+#elif defined(__linux__)
+    unsigned long long one = 1;
+    ssize_t written = write(p->notify_write_fd, &one, sizeof(one));
+    (void)written;
+#else
+    // 管道满了说明已经可读，写失败无妨
+    char one = 1;
+    ssize_t written = write(p->notify_write_fd, &one, 1);
+    (void)written;
+#endif
+}
+
+static void async_clear_notify(AsyncParser* p) {
+#ifdef _WIN32
+    ResetEvent(p->event);
+#elif defined(__linux__)
+    unsigned long long count;
+    ssize_t got = read(p->notify_fd, &count, sizeof(count));
+    (void)got;
+#else
+    char buffer[256];
+    while (read(p->notify_fd, buffer, sizeof(buffer)) > 0) {
+    }
+#endif
+}
+
+static AP_THREAD_PROC async_worker(void* arg) {
+    AsyncParser* p = (AsyncParser*)arg;
+    ParserContext* context = create_parser_context();
+    ParserContext* previous = context_enter(context);
+    
+    ap_mutex_lock(&p->lock);
+    for (;;) {
+        while (p->job_count == 0 && !p->closing) {
+            ap_cond_wait(&p->wake, &p->lock);
+        }
+        if (p->closing) break;
+        
+        AsyncJob job = p->jobs[p->job_head];
+        p->job_head = (p->job_head + 1) & (p->capacity - 1);
+        p->job_count--;
+        ap_mutex_unlock(&p->lock);
+        
+        AudioAsyncResult result;
+        result.tag = job.tag;
+        result.info.struct_size = sizeof(AudioStreamInfo);
+        if (job.path) {
+            get_audio_stream_info(job.path, &result.info);
+            ap_free(job.path);
+        } else {
+            get_audio_stream_info_from_buffer(job.data, job.size, &result.info);
+        }
+        
+        async_enqueue(p, &result);
+        async_notify(p);
+        ap_mutex_lock(&p->lock);
+    }
+    ap_mutex_unlock(&p->lock);
+    
+    context_leave(previous);
+    free_parser_context(context);
+    return AP_THREAD_EXIT;
+}
+
+static int async_open_notify(AsyncParser* p) {
+#ifdef _WIN32
+    p->event = CreateEventA(NULL, TRUE, FALSE, NULL);
+    return p->event != NULL;
+#elif defined(__linux__)
+    p->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    p->notify_write_fd = p->notify_fd;
+    return p->notify_fd >= 0;
+#else
+    int fds[2];
+    if (pipe(fds) != 0) return 0;
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    p->notify_fd = fds[0];
+    p->notify_write_fd = fds[1];
+    return 1;
+#endif
+}
+
+static void async_close_notify(AsyncParser* p) {
+#ifdef _WIN32
+    CloseHandle(p->event);
+#else
+    close(p->notify_fd);
+    if (p->notify_write_fd != p->notify_fd) close(p->notify_write_fd);
+#endif
+}
+
+// 等正在解析的请求做完后关闭；还在排队的请求和没取走的结果一并丢弃
+void free_async_parser(AsyncParser* p) {
+    if (!p) return;
+    
+    ap_mutex_lock(&p->lock);
+    p->closing = 1;
+    ap_cond_broadcast(&p->wake);
+    ap_mutex_unlock(&p->lock);
+    for (int i = 0; i < p->num_threads; i++) {
+        ap_thread_join(p->threads[i]);
+    }
+    
+    for (long long i = 0; i < p->job_count; i++) {
+        ap_free(p->jobs[(p->job_head + i) & (p->capacity - 1)].path);
+    }
+    async_close_notify(p);
+    ap_cond_destroy(&p->wake);
+    ap_mutex_destroy(&p->lock);
+    ap_free(p->jobs);
+    ap_free(p->cells);
+    ap_free(p);
+}
+
+// num_threads <= 0 时按CPU核数；capacity为同时未取走的请求上限，<= 0 时取默认值
+AsyncParser* create_async_parser(int num_threads, int capacity) {
+    if (num_threads <= 0) num_threads = ap_cpu_count();
+    if (num_threads > AP_MAX_THREADS) num_threads = AP_MAX_THREADS;
+    if (capacity <= 0) capacity = ASYNC_DEFAULT_CAPACITY;
+    
+    long long rounded = 1;
+    while (rounded < capacity) rounded *= 2;
+    
+    AsyncParser* p = (AsyncParser*)ap_calloc(1, sizeof(AsyncParser));
+    if (!p) return NULL;
+    p->capacity = rounded;
+    p->jobs = (AsyncJob*)ap_calloc((size_t)rounded, sizeof(AsyncJob));
+    p->cells = (AsyncCell*)ap_calloc((size_t)rounded, sizeof(AsyncCell));
+    if (!p->jobs || !p->cells || !async_open_notify(p)) {
+        ap_free(p->jobs);
+        ap_free(p->cells);
+        ap_free(p);
+        return NULL;
+    }
+    for (long long i = 0; i < rounded; i++) {
+        p->cells[i].sequence = i;
+    }
+    
+    ap_mutex_init(&p->lock);
+    ap_cond_init(&p->wake);
+    for (int i = 0; i < num_threads; i++) {
+        if (ap_thread_start(&p->threads[p->num_threads], async_worker, p)) p->num_threads++;
+    }
+    if (p->num_threads == 0) {
+        free_async_parser(p);
+        return NULL;
+    }
+    return p;
+}
+
+static int async_submit(AsyncParser* p, const AsyncJob* job) {
+    int ok = 0;
+    ap_mutex_lock(&p->lock);
+    if (!p->closing && ap_atomic_load64(&p->in_flight) < p->capacity) {
+        p->jobs[(p->job_head + p->job_count) & (p->capacity - 1)] = *job;
+        p->job_count++;
+        ap_atomic_add64(&p->in_flight, 1);
+        ap_cond_signal(&p->wake);
+        ok = 1;
+    }
+    ap_mutex_unlock(&p->lock);
+    return ok;
+}
+
+// 成功返回1；未取走的请求已达容量时返回0，先取走一些结果再提交
+int submit_async_parse(AsyncParser* p, const char* filename, unsigned long long tag) {
+    if (!p || !filename) return 0;
+    
+    size_t len = strlen(filename);
+    AsyncJob job;
+    memset(&job, 0, sizeof(job));
+    job.tag = tag;
+    job.path = (char*)ap_malloc(len + 1);
+    if (!job.path) return 0;
+    memcpy(job.path, filename, len + 1);
+    
+    if (!async_submit(p, &job)) {
+        ap_free(job.path);
+        return 0;
+    }
+    return 1;
+}
+
+// 不拷贝数据，缓冲区要保持有效直到取到对应结果
+int submit_async_parse_buffer(AsyncParser* p, const void* data, size_t size, unsigned long long tag) {
+    if (!p || (!data && size > 0)) return 0;
+    
+    AsyncJob job;
+    memset(&job, 0, sizeof(job));
+    job.tag = tag;
+    job.data = data;
+    job.size = size;
+    return async_submit(p, &job);
+}
+
+// 非阻塞地取走最多max_results个结果，返回个数；result_size是调用方的sizeof(AudioAsyncResult)
+int drain_async_results(AsyncParser* p, AudioAsyncResult* results, int max_results, size_t result_size) {
+    if (!p || !results || max_results <= 0 || result_size < sizeof(unsigned long long)) return 0;
+    if (result_size > sizeof(AudioAsyncResult)) {
+        memset(results, 0, result_size * (size_t)max_results);
+    }
+    
+    async_clear_notify(p);
+    
+    int count = 0;
+    AudioAsyncResult result;
+    while (count < max_results && async_dequeue(p, &result)) {
+        size_t size = result_size < sizeof(AudioAsyncResult) ? result_size : sizeof(AudioAsyncResult);
+        memcpy((char*)results + result_size * (size_t)count, &result, size);
+        count++;
+    }
+    ap_atomic_add64(&p->in_flight, -count);
+    
+    // 没取完的结果要让下一轮事件循环再醒一次
+    if (count == max_results && ap_atomic_load_acquire64(&p->enqueue_pos) != ap_atomic_load64(&p->dequeue_pos)) {
+        async_notify(p);
+    }
+    return count;
+}
+
+// 可读（Windows上为已置位的事件句柄）时表示有结果可取
+long long get_async_parser_handle(AsyncParser* p) {
+    if (!p) return -1;
+#ifdef _WIN32
+    return (long long)(size_t)p->event;
+#else
+    return p->notify_fd;
+#endif
+}
+
+// last非0时取本线程最近一次调用的统计，否则取所有线程的累计；按struct_size回填
+int get_parse_stats(AudioParseStats* stats, int last) {
+    if (!stats || stats->struct_size < sizeof(unsigned int) * 2) return 0;
+
+#ifdef AP_ENABLE_STATS
+    AudioParseStats result;
+    if (last) {
+        result = ap_call_stats.last;
+    } else {
+        for (size_t i = 0; i < AP_STATS_COUNTERS; i++) {
+            *ap_stats_counter(&result, i) = ap_atomic_load64(ap_stats_counter(&ap_total_stats, i));
+        }
+        result.strategy = AP_STRATEGY_NONE;
+        result.reserved = 0;
+    }
+    result.version = AUDIO_PARSE_STATS_VERSION;
+    
+    size_t size = stats->struct_size;
+    if (size > sizeof(AudioParseStats)) size = sizeof(AudioParseStats);
+    memcpy((char*)stats + sizeof(unsigned int), (const char*)&result + sizeof(unsigned int),
+           size - sizeof(unsigned int));
+    return 1;
+#else
+    (void)last;
+    return 0;
+#endif
+}
+
+void reset_parse_stats(void) {
+#ifdef AP_ENABLE_STATS
+    for (size_t i = 0; i < AP_STATS_COUNTERS; i++) {
+        ap_atomic_store64(ap_stats_counter(&ap_total_stats, i), 0);
+    }
+#endif
+}
+
+// 导出所有函数供Python使用
+AP_EXPORT int GetAudioDuration(const char* filename) {
+    return cached_audio_duration(filename);
+}
+
+AP_EXPORT int GetOggDuration(const char* filename) {
+    return get_ogg_duration(filename);
+}
+
+AP_EXPORT int GetOggLinks(const char* filename, AudioOggLink* links, int max_links, size_t link_size) {
+    return get_ogg_links(filename, links, max_links, link_size);
+}
+
+AP_EXPORT int GetFlacDuration(const char* filename) {
+    return get_flac_duration(filename);
+}
+
+AP_EXPORT int GetMp3Duration(const char* filename) {
+    return get_mp3_duration_export(filename);
+}
+
+AP_EXPORT int GetWavDuration(const char* filename) {
+    return get_wav_duration(filename);
+}
+AP_EXPORT int GetAudioDurationFromBuffer(const void* data, size_t size) {
+    return get_audio_duration_from_buffer(data, size);
+}
+
+AP_EXPORT int GetOggDurationFromBuffer(const void* data, size_t size) {
+    return get_ogg_duration_from_buffer(data, size);
+}
+
+AP_EXPORT int GetFlacDurationFromBuffer(const void* data, size_t size) {
+    return get_flac_duration_from_buffer(data, size);
+}
+
+AP_EXPORT int GetMp3DurationFromBuffer(const void* data, size_t size) {
+    return get_mp3_duration_from_buffer(data, size);
+}
+
+AP_EXPORT int GetWavDurationFromBuffer(const void* data, size_t size) {
+    return get_wav_duration_from_buffer(data, size);
+}
+
+// filenames/durations为等长数组，num_threads <= 0 时按CPU核数；返回成功解析的文件数
+AP_EXPORT int GetAudioDurationBatch(const char** filenames, int count, int* durations, int num_threads) {
+    return get_audio_duration_batch(filenames, count, durations, num_threads);
+}
+
+// 单线程深队列版本，适合冷存储上的大目录；queue_depth为同时在读的文件数，<= 0 时取默认值
+AP_EXPORT int GetAudioDurationBatchQueued(const char** filenames, int count, int* durations, int queue_depth) {
+    return get_audio_duration_batch_queued(filenames, count, durations, queue_depth);
+}
+
+// 递归扫描目录，每个音频文件回调一次（在工作线程里调用，但不会并发）；返回音频文件数，出错返回-1
+AP_EXPORT int ScanDirectory(const char* root, int flags, int num_threads, ScanCallback callback, void* user,
+                            long long* total_seconds) {
+    return scan_directory_callback(root, flags, num_threads, callback, user, total_seconds);
+}
+
+// 同上，结果打包进库分配的缓冲区，用完调用FreeScanBuffer释放
+AP_EXPORT int ScanDirectoryPacked(const char* root, int flags, int num_threads, void** buffer, size_t* size,
+                                  long long* total_seconds) {
+    return scan_directory_packed(root, flags, num_threads, buffer, size, total_seconds);
+}
+
+AP_EXPORT void FreeScanBuffer(void* buffer) {
+    ap_free(buffer);
+}
+
+// 时长缓存：index_path为NULL时只缓存在内存中；只记解析成功的时长
+// 启用和停用须在没有其他调用进行时做（停用会释放表），开着时查找和插入可以并发
+AP_EXPORT int EnableDurationCache(const char* index_path) {
+    return enable_duration_cache(index_path);
+}
+
+AP_EXPORT int SaveDurationCache(void) {
+    return save_duration_cache();
+}
+
+AP_EXPORT void DisableDurationCache(void) {
+    disable_duration_cache();
+}
+
+AP_EXPORT void GetDurationCacheStats(long long* hits, long long* misses, long long* entries) {
+    get_duration_cache_stats(hits, misses, entries);
+}
+
+// 一次解析取得全部流信息；调用前先把info->struct_size设为sizeof(AudioStreamInfo)，返回错误码
+AP_EXPORT int GetAudioStreamInfo(const char* filename, AudioStreamInfo* info) {
+    return get_audio_stream_info(filename, info);
+}
+
+AP_EXPORT int GetAudioStreamInfoFromBuffer(const void* data, size_t size, AudioStreamInfo* info) {
+    return get_audio_stream_info_from_buffer(data, size, info);
+}
+
+// 按区间读取的后端：回调取数据，预取策略见AudioIO
+AP_EXPORT int GetAudioStreamInfoFromIO(const AudioIO* io, const char* name_hint, AudioStreamInfo* info) {
+    return get_audio_stream_info_from_io(io, name_hint, info);
+}
+
+AP_EXPORT int GetAudioDurationFromIO(const AudioIO* io, const char* name_hint) {
+    return get_audio_duration_from_io(io, name_hint);
+}
+
+// 限定读盘字节数的时长估算（byte_budget <= 0 时取64KB）；调用前把struct_size设为sizeof(AudioDurationEstimate)
+AP_EXPORT int GetAudioDurationEstimate(const char* filename, long long byte_budget, AudioDurationEstimate* estimate) {
+    return get_audio_duration_estimate(filename, byte_budget, estimate);
+}
+
+// 推式流解析：name_hint为文件名或扩展名（可为NULL），内容认不出时按它猜格式
+AP_EXPORT StreamParser* CreateStreamParser(const char* name_hint) {
+    return create_stream_parser(name_hint);
+}
+
+// 送入下一块数据，返回STREAM_NEED_DATA / STREAM_DURATION_READY / STREAM_FAILED
+AP_EXPORT int FeedStreamParser(StreamParser* parser, const void* data, size_t size) {
+    return feed_stream_parser(parser, data, size);
+}
+
+// 当前已知的流信息；时长还不确定时返回AUDIO_ERR_PARSE
+AP_EXPORT int GetStreamParserInfo(StreamParser* parser, AudioStreamInfo* info) {
+    return get_stream_parser_info(parser, info);
+}
+
+// 数据已送完：处理缓冲区里的剩余数据，给出最终结果（Ogg/MP3逐帧的精确时长、按总字节数算的比特率）
+AP_EXPORT int FinishStreamParser(StreamParser* parser, AudioStreamInfo* info) {
+    return finish_stream_parser(parser, info);
+}
+
+AP_EXPORT void FreeStreamParser(StreamParser* parser) {
+    free_stream_parser(parser);
+}
+
+// 边写边读的文件：打开后反复调用PollGrowingFile，每次只读新追加的字节
+AP_EXPORT GrowingFile* OpenGrowingFile(const char* filename) {
+    return open_growing_file(filename);
+}
+
+AP_EXPORT int PollGrowingFile(GrowingFile* handle, AudioStreamInfo* info) {
+    return poll_growing_file(handle, info);
+}
+
+AP_EXPORT void CloseGrowingFile(GrowingFile* handle) {
+    close_growing_file(handle);
+}
+
+// 换掉库内部用的分配器：三个函数都给，或全为NULL恢复标准库；须在其他任何调用之前设置
+AP_EXPORT int SetAudioAllocator(AudioMallocFn malloc_fn, AudioReallocFn realloc_fn, AudioFreeFn free_fn) {
+    return set_audio_allocator(malloc_fn, realloc_fn, free_fn);
+}
+
+// 可复用的解析上下文：同一线程上反复解析时复用缓冲区，热起来之后不再分配内存；不能跨线程同时使用
+AP_EXPORT ParserContext* CreateParserContext(void) {
+    return create_parser_context();
+}
+
+AP_EXPORT int GetAudioDurationWithContext(ParserContext* context, const char* filename) {
+    return get_audio_duration_with_context(context, filename);
+}
+
+AP_EXPORT int GetAudioStreamInfoWithContext(ParserContext* context, const char* filename, AudioStreamInfo* info) {
+    return get_audio_stream_info_with_context(context, filename, info);
+}
+
+AP_EXPORT void FreeParserContext(ParserContext* context) {
+    free_parser_context(context);
+}
+
+// 异步解析：提交立即返回，内部线程池解析；GetAsyncParserHandle的描述符可读时用DrainAsyncResults取结果
+AP_EXPORT AsyncParser* CreateAsyncParser(int num_threads, int capacity) {
+    return create_async_parser(num_threads, capacity);
+}
+
+// tag原样带回结果里；未取走的请求已达容量时返回0
+AP_EXPORT int SubmitAsyncParse(AsyncParser* parser, const char* filename, unsigned long long tag) {
+    return submit_async_parse(parser, filename, tag);
+}
+
+// 数据不拷贝，取到对应结果前要保持有效
+AP_EXPORT int SubmitAsyncParseBuffer(AsyncParser* parser, const void* data, size_t size, unsigned long long tag) {
+    return submit_async_parse_buffer(parser, data, size, tag);
+}
+
+// 非阻塞，返回取到的结果数；result_size传sizeof(AudioAsyncResult)
+AP_EXPORT int DrainAsyncResults(AsyncParser* parser, AudioAsyncResult* results, int max_results, size_t result_size) {
+    return drain_async_results(parser, results, max_results, result_size);
+}
+
+// Linux上是eventfd，其他POSIX系统是管道读端，Windows上是事件句柄
+AP_EXPORT long long GetAsyncParserHandle(AsyncParser* parser) {
+    return get_async_parser_handle(parser);
+}
+
+AP_EXPORT void FreeAsyncParser(AsyncParser* parser) {
+    free_async_parser(parser);
+}
+
+// 解析统计：编译时未定义AP_ENABLE_STATS则返回0；调用前把stats->struct_size设为sizeof(AudioParseStats)
+AP_EXPORT int GetLastParseStats(AudioParseStats* stats) {
+    return get_parse_stats(stats, 1);
+}
+
+AP_EXPORT int GetParseStats(AudioParseStats* stats) {
+    return get_parse_stats(stats, 0);
+}
+
+AP_EXPORT void ResetParseStats(void) {
+    reset_parse_stats();
+}
+
+// 跳转索引：Build*SeekIndex一遍建好，或从sidecar载入；用完FreeSeekIndex
+AP_EXPORT SeekIndex* BuildOggSeekIndex(const char* filename, unsigned int interval_ms) {
+    return build_ogg_seek_index(filename, interval_ms);
+}
+
+// 有Xing/VBRI目录时直接换算（近似位置），否则逐帧建表；flags传AUDIO_SEEK_EXACT时总是逐帧
+AP_EXPORT SeekIndex* BuildMp3SeekIndex(const char* filename, unsigned int interval_ms, int flags) {
+    return build_mp3_seek_index(filename, interval_ms, flags);
+}
+
+// 返回目标时刻之前最近一个点的字节偏移，失败返回-1；point可为NULL
+AP_EXPORT long long LookupSeekIndex(const SeekIndex* index, double seconds, AudioSeekPoint* point) {
+    return lookup_seek_index(index, seconds, point);
+}
+
+// 调用前把info->struct_size设为sizeof(AudioSeekIndexInfo)
+AP_EXPORT int GetSeekIndexInfo(const SeekIndex* index, AudioSeekIndexInfo* info) {
+    return get_seek_index_info(index, info);
+}
+
+AP_EXPORT int GetSeekIndexPoints(const SeekIndex* index, AudioSeekPoint* points, int max_points, size_t point_size) {
+    return get_seek_index_points(index, points, max_points, point_size);
+}
+
+// 返回需要的字节数，buffer为NULL或不够大时不写
+AP_EXPORT size_t SerializeSeekIndex(const SeekIndex* index, void* buffer, size_t size) {
+    return serialize_seek_index(index, buffer, size);
+}
+
+AP_EXPORT SeekIndex* LoadSeekIndexFromBuffer(const void* data, size_t size) {
+    return load_seek_index_from_buffer(data, size);
+}
+
+AP_EXPORT int SaveSeekIndex(const SeekIndex* index, const char* path) {
+    return save_seek_index(index, path);
+}
+
+AP_EXPORT SeekIndex* LoadSeekIndex(const char* path) {
+    return load_seek_index(path);
+}
+
+AP_EXPORT void FreeSeekIndex(SeekIndex* index) {
+    free_seek_index(index);
+}
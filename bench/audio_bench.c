@@ -0,0 +1,934 @@
+// audio_bench.c - 基准测试与合成语料生成器
+//
+// 构建（与库放在同一个编译单元里，可以直接用内部的CRC等函数）：
+//   gcc -O2 -pthread -o audio_bench bench/audio_bench.c
+//   加 -DAP_ENABLE_STATS 会额外打印每个文件的解析策略和读盘统计
+//   x86_64-w64-mingw32-gcc -O2 -o audio_bench.exe bench/audio_bench.c
+//
+// 用法：
+//   audio_bench [--dir 目录] [--quick] [--iterations N]
+//               [--save-baseline 文件] [--baseline 文件]
+//
+// 首次运行会在目录下生成确定性的合成语料（之后复用），校验每个文件的解析结果，
+// 统计带解析上下文时每次调用的堆分配次数（预热后不为0算失败），
+// 把每个文件分块喂给推式流解析器（收尾结果与GetAudioDuration不一致算失败），
+// 用本地文件模拟区间读取网关，统计自定义I/O每个文件发出的请求数（结果与文件接口不一致算失败），
+// 再对GetAudioDuration和各格式入口分别在热/冷页缓存下计时，输出
+// files/s、MB/s、每文件读系统调用数和p50/p99延迟。
+#include "../audio_parser.c"
+#include <time.h>
+
+#define BENCH_MAX_ITERATIONS 100000
+#define BENCH_ESTIMATE_SLACK 0.001    // 估值和期望值比较时容许的浮点舍入
+#define BENCH_STREAM_CHUNK   7777     // 推式流解析每次喂的字节数，故意不对齐，帧头和页头会跨块
+
+// 语料类型
+#define CORPUS_MP3_CBR    0
+#define CORPUS_MP3_VBR    1
+#define CORPUS_OGG_VORBIS 2
+#define CORPUS_OGG_OPUS   3
+#define CORPUS_FLAC       4
+#define CORPUS_WAV        5
+
+#define CORPUS_XING 0x1   // MP3带Xing/LAME头
+#define CORPUS_ID3  0x2   // MP3带小ID3标签
+#define CORPUS_ART  0x4   // MP3带大封面ID3标签和前导垃圾数据
+#define CORPUS_CHAIN 0x8  // Ogg拼成三节的链式流，每节换一个序列号
+#define CORPUS_STREAMED 0x10  // FLAC的STREAMINFO总样本数写0（流式编码），只能靠最后一帧
+
+typedef struct {
+    const char* name;
+    int kind;
+    int flags;
+    double seconds;
+    int quick;          // --quick 时也生成
+} CorpusSpec;
+
+static const CorpusSpec corpus_specs[] = {
+    { "mp3_cbr_5s.mp3",         CORPUS_MP3_CBR,    CORPUS_ID3,               5,    1 },
+    { "mp3_cbr_5m.mp3",         CORPUS_MP3_CBR,    0,                        300,  1 },
+    { "mp3_cbr_1h.mp3",         CORPUS_MP3_CBR,    CORPUS_ID3,               3600, 0 },
+    { "mp3_vbr_xing_5m.mp3",    CORPUS_MP3_VBR,    CORPUS_XING | CORPUS_ID3, 300,  1 },
+    { "mp3_vbr_xing_1h.mp3",    CORPUS_MP3_VBR,    CORPUS_XING,              3600, 0 },
+    { "mp3_vbr_5m.mp3",         CORPUS_MP3_VBR,    0,                        300,  1 },
+    { "mp3_vbr_1h.mp3",         CORPUS_MP3_VBR,    CORPUS_ID3,               3600, 0 },
+    { "mp3_vbr_art_5m.mp3",     CORPUS_MP3_VBR,    CORPUS_ART,               300,  1 },
+    { "ogg_vorbis_5s.ogg",      CORPUS_OGG_VORBIS, 0,                        5,    1 },
+    { "ogg_vorbis_5m.ogg",      CORPUS_OGG_VORBIS, 0,                        300,  1 },
+    { "ogg_vorbis_1h.ogg",      CORPUS_OGG_VORBIS, 0,                        3600, 0 },
+    { "ogg_opus_5m.opus",       CORPUS_OGG_OPUS,   0,                        300,  1 },
+    { "ogg_opus_1h.opus",       CORPUS_OGG_OPUS,   0,                        3600, 0 },
+    { "ogg_chain_5m.opus",      CORPUS_OGG_OPUS,   CORPUS_CHAIN,             300,  1 },
+    { "flac_5s.flac",           CORPUS_FLAC,       0,                        5,    1 },
+    { "flac_5m.flac",           CORPUS_FLAC,       0,                        300,  1 },
+    { "flac_streamed_5m.flac",  CORPUS_FLAC,       CORPUS_STREAMED,          300,  1 },
+    { "flac_1h.flac",           CORPUS_FLAC,       0,                        3600, 0 },
+    { "wav_5s.wav",             CORPUS_WAV,        0,                        5,    1 },
+    { "wav_1h.wav",             CORPUS_WAV,        0,                        3600, 0 },
+};
+
+#define CORPUS_COUNT ((int)(sizeof(corpus_specs) / sizeof(corpus_specs[0])))
+
+// 每个文件的期望结果
+typedef struct {
+    const CorpusSpec* spec;
+    char path[1024];
+    double expected;        // 期望时长（秒），整秒接口应返回它的整数部分
+    long long size;
+} CorpusFile;
+
+// 确定性伪随机数
+static unsigned int bench_rand_state = 0x12345678u;
+
+static unsigned int bench_rand(void) {
+    unsigned int x = bench_rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    bench_rand_state = x;
+    return x;
+}
+
+static void put_be32(unsigned char* p, unsigned int v) {
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static void put_le16(unsigned char* p, unsigned int v) {
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+}
+
+static void put_le32(unsigned char* p, unsigned int v) {
+    put_le16(p, v & 0xFFFF);
+    put_le16(p + 2, v >> 16);
+}
+
+static void put_le64(unsigned char* p, unsigned long long v) {
+    put_le32(p, (unsigned int)v);
+    put_le32(p + 4, (unsigned int)(v >> 32));
+}
+
+static void write_zeros(FILE* file, long long count) {
+    static const unsigned char zeros[4096];
+    while (count > 0) {
+        size_t n = count > (long long)sizeof(zeros) ? sizeof(zeros) : (size_t)count;
+        fwrite(zeros, 1, n, file);
+        count -= (long long)n;
+    }
+}
+
+// 落盘后才能在冷缓存测试时把页缓存丢掉
+static void finish_file(FILE* file) {
+    fflush(file);
+#ifndef _WIN32
+    fsync(fileno(file));
+#endif
+    fclose(file);
+}
+
+// MP3：MPEG1 Layer III，44.1kHz立体声
+static const int bench_mp3_bitrates[] = { 64, 128, 160, 320 };
+static const int bench_mp3_indexes[] = { 5, 9, 10, 14 };
+
+static int mp3_frame_bytes(int bitrate_kbps) {
+    return 144 * bitrate_kbps * 1000 / 44100;
+}
+
+static void write_mp3_frame_header(unsigned char* p, int bitrate_index) {
+    put_be32(p, 0xFFFB0000u | ((unsigned int)bitrate_index << 12));
+}
+
+static void write_id3_tag(FILE* file, int size) {
+    unsigned char header[10] = { 'I', 'D', '3', 4, 0, 0 };
+    header[6] = (unsigned char)((size >> 21) & 0x7F);
+    header[7] = (unsigned char)((size >> 14) & 0x7F);
+    header[8] = (unsigned char)((size >> 7) & 0x7F);
+    header[9] = (unsigned char)(size & 0x7F);
+    fwrite(header, 1, 10, file);
+    
+    // 一个APIC帧占满整个标签，内容是伪随机数据（会包含假同步字）
+    unsigned char frame[10] = { 'A', 'P', 'I', 'C' };
+    put_be32(frame + 4, (unsigned int)(size - 10));
+    fwrite(frame, 1, 10, file);
+    for (int i = 0; i < size - 10; i++) fputc((int)(bench_rand() & 0xFF), file);
+}
+
+static double generate_mp3(const char* path, const CorpusSpec* spec) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return -1;
+    
+    int vbr = spec->kind == CORPUS_MP3_VBR;
+    long long frames = (long long)(spec->seconds * 44100 / 1152);
+    
+    // 先定好每帧比特率，Xing头需要总字节数
+    unsigned char* choice = (unsigned char*)malloc((size_t)frames);
+    long long audio_bytes = 0;
+    for (long long i = 0; i < frames; i++) {
+        choice[i] = (unsigned char)(vbr ? bench_rand() % 4 : 1);
+        audio_bytes += mp3_frame_bytes(bench_mp3_bitrates[choice[i]]);
+    }
+    
+    if (spec->flags & CORPUS_ART) {
+        write_id3_tag(file, 2 * 1024 * 1024);
+        for (int i = 0; i < 100000; i++) fputc(0x55, file);
+    } else if (spec->flags & CORPUS_ID3) {
+        write_id3_tag(file, 4096);
+    }
+    
+    if (spec->flags & CORPUS_XING) {
+        unsigned char frame[417];
+        memset(frame, 0, sizeof(frame));
+        write_mp3_frame_header(frame, 9);
+        
+        unsigned char* xing = frame + 4 + 32;
+        memcpy(xing, "Xing", 4);
+        put_be32(xing + 4, 0x0F);
+        put_be32(xing + 8, (unsigned int)frames);
+        put_be32(xing + 12, (unsigned int)audio_bytes);
+        for (int i = 0; i < 100; i++) xing[16 + i] = (unsigned char)(i * 256 / 100);
+        put_be32(xing + 116, 50);
+        
+        unsigned char* lame = xing + 120;
+        memcpy(lame, "LAME3.100", 9);
+        lame[21] = 576 >> 4;                       // 编码器延迟576
+        lame[22] = (unsigned char)(((576 & 0x0F) << 4) | (1000 >> 8));
+        lame[23] = 1000 & 0xFF;                    // 填充1000
+        put_be32(lame + 28, (unsigned int)(audio_bytes + sizeof(frame)));
+        fwrite(frame, 1, sizeof(frame), file);
+    }
+    
+    unsigned char frame[1044];
+    memset(frame, 0, sizeof(frame));
+    for (long long i = 0; i < frames; i++) {
+        int size = mp3_frame_bytes(bench_mp3_bitrates[choice[i]]);
+        write_mp3_frame_header(frame, bench_mp3_indexes[choice[i]]);
+        fwrite(frame, 1, (size_t)size, file);
+    }
+    
+    free(choice);
+    finish_file(file);
+    
+    // LAME头给出的延迟和填充要从总样本数里扣掉
+    return (spec->flags & CORPUS_XING) ? (frames * 1152.0 - 576 - 1000) / 44100 : frames * 1152.0 / 44100;
+}
+
+// OGG：Vorbis每0.25秒一页，每页4000字节；Opus每0.1秒一页，每页1600字节
+static void write_ogg_page(FILE* file, const unsigned char* data, int size, unsigned long long granule,
+                           unsigned int serial, unsigned int sequence, int header_type) {
+    unsigned char header[27 + 255];
+    int segments = size / 255 + 1;
+    
+    memcpy(header, OGG_PAGE_HEADER, 4);
+    header[4] = 0;
+    header[5] = (unsigned char)header_type;
+    put_le64(header + 6, granule);
+    put_le32(header + 14, serial);
+    put_le32(header + 18, sequence);
+    put_le32(header + 22, 0);
+    header[26] = (unsigned char)segments;
+    for (int i = 0; i < segments - 1; i++) header[27 + i] = 255;
+    header[27 + segments - 1] = (unsigned char)(size % 255);
+    
+    unsigned int crc = ogg_crc32(0, header, (size_t)(27 + segments));
+    crc = ogg_crc32(crc, data, (size_t)size);
+    put_le32(header + 22, crc);
+    
+    fwrite(header, 1, (size_t)(27 + segments), file);
+    fwrite(data, 1, (size_t)size, file);
+}
+
+static double generate_ogg(const char* path, const CorpusSpec* spec) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return -1;
+    
+    int opus = spec->kind == CORPUS_OGG_OPUS;
+    int links = (spec->flags & CORPUS_CHAIN) ? 3 : 1;
+    unsigned char packet[4000];
+    unsigned int granule_rate = opus ? 48000 : 44100;
+    unsigned int pre_skip = opus ? 312 : 0;
+    
+    for (int link = 0; link < links; link++) {
+        unsigned int serial = 0x41504453 + (unsigned int)link;
+        unsigned int sequence = 0;
+        
+        memset(packet, 0, sizeof(packet));
+        if (opus) {
+            memcpy(packet, "OpusHead", 8);
+            packet[8] = 1;
+            packet[9] = 2;
+            put_le16(packet + 10, pre_skip);
+            put_le32(packet + 12, 48000);
+            write_ogg_page(file, packet, 19, 0, serial, sequence++, 2);
+            
+            memset(packet, 0, 32);
+            memcpy(packet, "OpusTags", 8);
+            write_ogg_page(file, packet, 24, 0, serial, sequence++, 0);
+        } else {
+            memcpy(packet, "\x01vorbis", 7);
+            packet[11] = 2;
+            put_le32(packet + 12, 44100);
+            put_le32(packet + 20, 128000);
+            packet[28] = 0xB8;
+            packet[29] = 1;
+            write_ogg_page(file, packet, 30, 0, serial, sequence++, 2);
+            
+            memset(packet, 0, 200);
+            memcpy(packet, "\x03vorbis", 7);
+            memcpy(packet + 60, "\x05vorbis", 7);
+            write_ogg_page(file, packet, 200, 0, serial, sequence++, 0);
+        }
+        
+        // Opus包的TOC要合法，库靠它数出首页的样本数：config 31（20ms）、code 3、5帧，共4800样本
+        unsigned long long total = (unsigned long long)(spec->seconds / links * granule_rate) + pre_skip;
+        unsigned long long granule = 0;
+        unsigned int page_granules = opus ? 4800 : granule_rate / 4;
+        int packet_size = opus ? 1600 : (int)sizeof(packet);
+        while (granule < total) {
+            granule += page_granules;
+            if (granule > total) granule = total;
+            for (int i = 0; i < packet_size; i++) packet[i] = (unsigned char)bench_rand();
+            if (opus) {
+                packet[0] = 0xFB;
+                packet[1] = 5;
+            }
+            write_ogg_page(file, packet, packet_size, granule, serial, sequence++, granule == total ? 4 : 0);
+        }
+    }
+    
+    finish_file(file);
+    return spec->seconds;
+}
+
+// FLAC：4096样本一帧，STREAMINFO后跟1MB PICTURE和64KB PADDING
+static unsigned char bench_crc8(const unsigned char* data, size_t len) {
+    unsigned char crc = 0;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) crc = (unsigned char)((crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1);
+    }
+    return crc;
+}
+
+static int put_utf8_number(unsigned char* p, unsigned int n) {
+    if (n < 0x80) {
+        p[0] = (unsigned char)n;
+        return 1;
+    }
+    if (n < 0x800) {
+        p[0] = (unsigned char)(0xC0 | (n >> 6));
+        p[1] = (unsigned char)(0x80 | (n & 0x3F));
+        return 2;
+    }
+    if (n < 0x10000) {
+        p[0] = (unsigned char)(0xE0 | (n >> 12));
+        p[1] = (unsigned char)(0x80 | ((n >> 6) & 0x3F));
+        p[2] = (unsigned char)(0x80 | (n & 0x3F));
+        return 3;
+    }
+    p[0] = (unsigned char)(0xF0 | (n >> 18));
+    p[1] = (unsigned char)(0x80 | ((n >> 12) & 0x3F));
+    p[2] = (unsigned char)(0x80 | ((n >> 6) & 0x3F));
+    p[3] = (unsigned char)(0x80 | (n & 0x3F));
+    return 4;
+}
+
+static void write_flac_block_header(FILE* file, int type, int last, unsigned int length) {
+    unsigned char header[4];
+    header[0] = (unsigned char)((last ? 0x80 : 0) | type);
+    header[1] = (unsigned char)(length >> 16);
+    header[2] = (unsigned char)(length >> 8);
+    header[3] = (unsigned char)length;
+    fwrite(header, 1, 4, file);
+}
+
+static double generate_flac(const char* path, const CorpusSpec* spec) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return -1;
+    
+    unsigned long long total = (unsigned long long)(spec->seconds * 44100);
+    fwrite(FLAC_SIGNATURE, 1, 4, file);
+    
+    unsigned char streaminfo[34];
+    memset(streaminfo, 0, sizeof(streaminfo));
+    streaminfo[0] = 0x10;  // 最小/最大块大小4096
+    streaminfo[2] = 0x10;
+    unsigned long long packed = (44100ULL << 44) | (1ULL << 41) | (15ULL << 36);
+    if (!(spec->flags & CORPUS_STREAMED)) packed |= total;
+    for (int i = 0; i < 8; i++) streaminfo[10 + i] = (unsigned char)(packed >> ((7 - i) * 8));
+    write_flac_block_header(file, 0, 0, 34);
+    fwrite(streaminfo, 1, 34, file);
+    
+    write_flac_block_header(file, 6, 0, 1024 * 1024);
+    write_zeros(file, 1024 * 1024);
+    write_flac_block_header(file, 1, 1, 65536);
+    write_zeros(file, 65536);
+    
+    unsigned char frame[640];
+    unsigned int frames = (unsigned int)((total + 4095) / 4096);
+    for (unsigned int i = 0; i < frames; i++) {
+        unsigned int block = (i + 1 == frames && total % 4096) ? (unsigned int)(total % 4096) : 4096;
+        int n = 0;
+        frame[n++] = 0xFF;
+        frame[n++] = 0xF8;
+        frame[n++] = (unsigned char)(((block == 4096 ? 12 : 7) << 4) | 9);  // 块大小码，44.1kHz
+        frame[n++] = (1 << 4) | (4 << 1);                                     // 立体声，16位
+        n += put_utf8_number(frame + n, i);
+        if (block != 4096) {
+            frame[n++] = (unsigned char)((block - 1) >> 8);
+            frame[n++] = (unsigned char)(block - 1);
+        }
+        frame[n] = bench_crc8(frame, (size_t)n);
+        n++;
+        memset(frame + n, 0, sizeof(frame) - (size_t)n);
+        fwrite(frame, 1, 600, file);
+    }
+    
+    finish_file(file);
+    return (double)total / 44100;
+}
+
+// WAV：JUNK + fmt + LIST + data，data内容留空洞（稀疏文件）
+static double generate_wav(const char* path, const CorpusSpec* spec) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return -1;
+    
+    unsigned int data_size = (unsigned int)(spec->seconds * 44100) * 4;
+    unsigned char header[12 + 8 + 28 + 8 + 16 + 8 + 26 + 8];
+    unsigned char* p = header;
+    
+    memcpy(p, "RIFF", 4);
+    put_le32(p + 4, (unsigned int)(sizeof(header) - 8 + data_size));
+    memcpy(p + 8, "WAVE", 4);
+    p += 12;
+    memcpy(p, "JUNK", 4);
+    put_le32(p + 4, 28);
+    memset(p + 8, 0, 28);
+    p += 8 + 28;
+    memcpy(p, "fmt ", 4);
+    put_le32(p + 4, 16);
+    put_le16(p + 8, 1);
+    put_le16(p + 10, 2);
+    put_le32(p + 12, 44100);
+    put_le32(p + 16, 44100 * 4);
+    put_le16(p + 20, 4);
+    put_le16(p + 22, 16);
+    p += 8 + 16;
+    memcpy(p, "LIST", 4);
+    put_le32(p + 4, 26);
+    memset(p + 8, 0, 26);
+    memcpy(p + 8, "INFOISFT", 8);
+    p += 8 + 26;
+    memcpy(p, "data", 4);
+    put_le32(p + 4, data_size);
+    
+    fwrite(header, 1, sizeof(header), file);
+    if (data_size > 0) {
+        fseek(file, (long)data_size - 1, SEEK_CUR);
+        fputc(0, file);
+    }
+    
+    finish_file(file);
+    return (double)(data_size / 4) / 44100;
+}
+
+static long long file_size_of(const char* path) {
+    BlockReader reader;
+    if (!reader_open_file(&reader, path)) return -1;
+    long long size = reader.size;
+    reader_close(&reader);
+    return size;
+}
+
+static int prepare_corpus(const char* dir, int quick, CorpusFile* files) {
+    int count = 0;
+    
+    for (int i = 0; i < CORPUS_COUNT; i++) {
+        const CorpusSpec* spec = &corpus_specs[i];
+        if (quick && !spec->quick) continue;
+        
+        CorpusFile* f = &files[count];
+        f->spec = spec;
+        snprintf(f->path, sizeof(f->path), "%s/%s", dir, spec->name);
+        
+        // 生成器是确定性的：种子按文件固定，已有文件直接复用，只重算期望值
+        bench_rand_state = 0x12345678u + (unsigned int)i * 7919u;
+        FILE* existing = fopen(f->path, "rb");
+        const char* target = f->path;
+        char scratch[1100];
+        if (existing) {
+            fclose(existing);
+            snprintf(scratch, sizeof(scratch), "%s.tmp", f->path);
+            target = scratch;
+        }
+        
+        switch (spec->kind) {
+            case CORPUS_MP3_CBR:
+            case CORPUS_MP3_VBR:
+                f->expected = generate_mp3(target, spec);
+                break;
+            case CORPUS_OGG_VORBIS:
+            case CORPUS_OGG_OPUS:
+                f->expected = generate_ogg(target, spec);
+                break;
+            case CORPUS_FLAC:
+                f->expected = generate_flac(target, spec);
+                break;
+            default:
+                f->expected = generate_wav(target, spec);
+                break;
+        }
+        
+        // 生成器改过的话新旧文件大小对不上，换成新生成的
+        if (existing && file_size_of(target) != file_size_of(f->path)) {
+            remove(f->path);
+            rename(target, f->path);
+        } else if (existing) {
+            remove(target);
+        }
+        if (f->expected < 0) {
+            fprintf(stderr, "cannot write %s\n", f->path);
+            return -1;
+        }
+        
+        f->size = file_size_of(f->path);
+        count++;
+    }
+    return count;
+}
+
+// 计数分配器：统计库内部的堆分配次数，验证带上下文的解析路径热起来后不再分配
+static long long bench_allocations;
+
+static void* counting_malloc(size_t size) {
+    bench_allocations++;
+    return malloc(size);
+}
+
+static void* counting_realloc(void* ptr, size_t size) {
+    bench_allocations++;
+    return realloc(ptr, size);
+}
+
+static void counting_free(void* ptr) {
+    free(ptr);
+}
+
+// 区间读取网关的本地替身：每次read_at算一次请求
+typedef struct {
+    FILE* file;
+    long long size;
+    int requests;
+    long long bytes;
+} RangeFile;
+
+static long long range_read_at(void* user, long long offset, void* buffer, size_t len) {
+    RangeFile* range = (RangeFile*)user;
+    range->requests++;
+#ifdef _WIN32
+    if (_fseeki64(range->file, offset, SEEK_SET) != 0) return -1;
+#else
+    if (fseeko(range->file, (off_t)offset, SEEK_SET) != 0) return -1;
+#endif
+    size_t got = fread(buffer, 1, len, range->file);
+    range->bytes += (long long)got;
+    return (long long)got;
+}
+
+static long long range_size(void* user) {
+    return ((RangeFile*)user)->size;
+}
+
+// 计时与I/O计数
+static long long bench_now_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (long long)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+#endif
+}
+
+// 进程累计的读操作次数；拿不到时返回-1
+static long long read_syscall_count(void) {
+#ifdef _WIN32
+    IO_COUNTERS io;
+    if (!GetProcessIoCounters(GetCurrentProcess(), &io)) return -1;
+    return (long long)io.ReadOperationCount;
+#else
+    FILE* file = fopen("/proc/self/io", "r");
+    if (!file) return -1;
+    char line[128];
+    long long count = -1;
+    while (fgets(line, sizeof(line), file)) {
+        if (strncmp(line, "syscr:", 6) == 0) {
+            count = atoll(line + 6);
+            break;
+        }
+    }
+    fclose(file);
+    return count;
+#endif
+}
+
+// 读/proc/self/io本身也算读调用，测一次空转的开销扣掉
+static long long read_syscall_overhead(void) {
+    long long a = read_syscall_count();
+    long long b = read_syscall_count();
+    return (a < 0 || b < 0) ? 0 : b - a;
+}
+
+// 把文件从页缓存里踢出去；不支持的平台返回0
+static int drop_page_cache(const char* path) {
+#if defined(__linux__)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    int ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return ok;
+#else
+    (void)path;
+    return 0;
+#endif
+}
+
+typedef int (*duration_fn)(const char*);
+
+typedef struct {
+    const char* name;
+    duration_fn fn;
+} EntryPoint;
+
+static void format_entry_for(const CorpusSpec* spec, EntryPoint* entry) {
+    switch (spec->kind) {
+        case CORPUS_MP3_CBR:
+        case CORPUS_MP3_VBR:
+            entry->name = "GetMp3Duration";
+            entry->fn = GetMp3Duration;
+            break;
+        case CORPUS_OGG_VORBIS:
+        case CORPUS_OGG_OPUS:
+            entry->name = "GetOggDuration";
+            entry->fn = GetOggDuration;
+            break;
+        case CORPUS_FLAC:
+            entry->name = "GetFlacDuration";
+            entry->fn = GetFlacDuration;
+            break;
+        default:
+            entry->name = "GetWavDuration";
+            entry->fn = GetWavDuration;
+            break;
+    }
+}
+
+typedef struct {
+    char key[256];          // 文件 入口 模式
+    int iterations;
+    double p50_us;
+    double p99_us;
+    double files_per_s;
+    double mb_per_s;
+    double syscalls;        // 每文件读调用数，<0 表示拿不到
+} BenchResult;
+
+static int compare_ll(const void* a, const void* b) {
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return x < y ? -1 : x > y;
+}
+
+static int run_one(const CorpusFile* f, const EntryPoint* entry, int cold, int iterations,
+                   long long* samples, BenchResult* result) {
+    long long overhead = read_syscall_overhead();
+    long long syscalls = 0;
+    long long total_ns = 0;
+    int have_syscalls = 1;
+    
+    if (cold && !drop_page_cache(f->path)) return 0;
+    
+    entry->fn(f->path);  // 预热（冷模式下每次调用前都会重新踢出缓存）
+    
+    for (int i = 0; i < iterations; i++) {
+        if (cold) drop_page_cache(f->path);
+        
+        long long before = read_syscall_count();
+        long long start = bench_now_ns();
+        entry->fn(f->path);
+        long long elapsed = bench_now_ns() - start;
+        long long after = read_syscall_count();
+        
+        samples[i] = elapsed;
+        total_ns += elapsed;
+        if (before < 0 || after < 0) have_syscalls = 0;
+        else syscalls += after - before - overhead;
+    }
+    
+    qsort(samples, (size_t)iterations, sizeof(long long), compare_ll);
+    
+    snprintf(result->key, sizeof(result->key), "%s %s %s", f->spec->name, entry->name, cold ? "cold" : "warm");
+    result->iterations = iterations;
+    result->p50_us = samples[iterations / 2] / 1000.0;
+    result->p99_us = samples[(iterations * 99) / 100 < iterations ? (iterations * 99) / 100 : iterations - 1] / 1000.0;
+    result->files_per_s = total_ns > 0 ? iterations * 1e9 / (double)total_ns : 0;
+    result->mb_per_s = result->files_per_s * (double)f->size / 1e6;
+    result->syscalls = have_syscalls ? (double)syscalls / iterations : -1;
+    return 1;
+}
+
+// 基准线文件：每行 "文件 入口 模式 p50_us p99_us files_per_s"
+static void save_baseline(const char* path, const BenchResult* results, int count) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "cannot write baseline %s\n", path);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "%s %.3f %.3f %.1f\n", results[i].key, results[i].p50_us, results[i].p99_us,
+                results[i].files_per_s);
+    }
+    fclose(file);
+    printf("\nbaseline saved to %s\n", path);
+}
+
+static void compare_baseline(const char* path, const BenchResult* results, int count) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "cannot read baseline %s\n", path);
+        return;
+    }
+    
+    printf("\n%-48s %12s %12s %10s\n", "compared with baseline", "p50 before", "p50 now", "change");
+    char name[128], entry[64], mode[16];
+    double p50, p99, fps;
+    while (fscanf(file, "%127s %63s %15s %lf %lf %lf", name, entry, mode, &p50, &p99, &fps) == 6) {
+        char key[256];
+        snprintf(key, sizeof(key), "%s %s %s", name, entry, mode);
+        for (int i = 0; i < count; i++) {
+            if (strcmp(results[i].key, key) != 0) continue;
+            double change = p50 > 0 ? (results[i].p50_us - p50) / p50 * 100.0 : 0;
+            printf("%-48s %10.1fus %10.1fus %+9.1f%%\n", key, p50, results[i].p50_us, change);
+        }
+    }
+    fclose(file);
+}
+
+int main(int argc, char** argv) {
+    const char* dir = "bench_corpus";
+    const char* save_path = NULL;
+    const char* baseline_path = NULL;
+    int quick = 0;
+    int iterations = 0;
+    
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc) dir = argv[++i];
+        else if (strcmp(argv[i], "--quick") == 0) quick = 1;
+        else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--save-baseline") == 0 && i + 1 < argc) save_path = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) baseline_path = argv[++i];
+        else {
+            fprintf(stderr, "usage: %s [--dir DIR] [--quick] [--iterations N] "
+                            "[--save-baseline FILE] [--baseline FILE]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (iterations <= 0) iterations = quick ? 20 : 200;
+    if (iterations > BENCH_MAX_ITERATIONS) iterations = BENCH_MAX_ITERATIONS;
+    SetAudioAllocator(counting_malloc, counting_realloc, counting_free);
+
+#ifdef _WIN32
+    CreateDirectoryA(dir, NULL);
+#else
+    mkdir(dir, 0755);
+#endif
+
+    CorpusFile files[CORPUS_COUNT];
+    int file_count = prepare_corpus(dir, quick, files);
+    if (file_count <= 0) return 1;
+    
+    // 正确性：所有入口的结果都要落在期望值附近
+    int mismatches = 0;
+    for (int i = 0; i < file_count; i++) {
+        EntryPoint entry;
+        format_entry_for(files[i].spec, &entry);
+        int got_auto = GetAudioDuration(files[i].path);
+        int got_format = entry.fn(files[i].path);
+        double expected = files[i].expected;
+        int ok = got_auto == (int)expected && got_format == got_auto;
+        if (!ok) {
+            printf("MISMATCH %-24s expected %.3fs, GetAudioDuration %d, %s %d\n", files[i].spec->name,
+                   expected, got_auto, entry.name, got_format);
+            mismatches++;
+        }
+    }
+    printf("correctness: %d/%d files ok\n\n", file_count - mismatches, file_count);
+    
+    // 每次调用的堆分配次数：不带上下文时每个文件分配一次块缓冲区，带上下文预热后应为0
+    ParserContext* context = CreateParserContext();
+    printf("%-28s %12s %12s %12s\n", "file (allocations/call)", "plain", "context", "stream-info");
+    for (int i = 0; context && i < file_count; i++) {
+        AudioStreamInfo info;
+        info.struct_size = sizeof(info);
+        GetAudioDurationWithContext(context, files[i].path);
+        
+        long long before = bench_allocations;
+        GetAudioDuration(files[i].path);
+        long long plain = bench_allocations - before;
+        
+        before = bench_allocations;
+        GetAudioDurationWithContext(context, files[i].path);
+        long long with_context = bench_allocations - before;
+        
+        before = bench_allocations;
+        GetAudioStreamInfoWithContext(context, files[i].path, &info);
+        long long stream_info = bench_allocations - before;
+        
+        printf("%-28s %12lld %12lld %12lld\n", files[i].spec->name, plain, with_context, stream_info);
+        if (with_context != 0 || stream_info != 0) {
+            printf("ALLOCATION %-22s context path allocated on a warm context\n", files[i].spec->name);
+            mismatches++;
+        }
+    }
+    FreeParserContext(context);
+    printf("\n");
+
+#ifdef AP_ENABLE_STATS
+    // 每个文件走了哪条路径、读了多少
+    static const char* strategy_names[] = { "none", "header", "xing", "cbr-estimate", "full-walk",
+                                            "ogg-tail", "ogg-scan", "cache", "estimate", "flac-tail" };
+    printf("%-28s %-13s %10s %7s %6s %8s %10s\n", "file", "strategy", "bytes", "reads", "seeks", "frames",
+           "resync");
+    for (int i = 0; i < file_count; i++) {
+        AudioParseStats stats;
+        stats.struct_size = sizeof(stats);
+        GetAudioDuration(files[i].path);
+        GetLastParseStats(&stats);
+        printf("%-28s %-13s %10lld %7lld %6lld %8lld %10lld\n", files[i].spec->name,
+               stats.strategy < 10 ? strategy_names[stats.strategy] : "?", stats.bytes_read, stats.reads,
+               stats.seeks, stats.frames, stats.resync_bytes);
+    }
+    printf("\n");
+#endif
+
+    // 限定读盘量的估算：默认64KB预算下的估值、误差范围和实际读盘量；出错或期望值落在误差范围外都算失败
+    printf("%-28s %10s %10s %10s %6s %10s\n", "file (64KB estimate)", "expected", "estimate", "bound", "exact",
+           "bytes");
+    for (int i = 0; i < file_count; i++) {
+        AudioDurationEstimate estimate;
+        estimate.struct_size = sizeof(estimate);
+        if (GetAudioDurationEstimate(files[i].path, 0, &estimate) != AUDIO_OK) {
+            printf("%-28s %10.2f %10s\n", files[i].spec->name, files[i].expected, "error");
+            printf("ESTIMATE %-24s GetAudioDurationEstimate failed\n", files[i].spec->name);
+            mismatches++;
+            continue;
+        }
+        printf("%-28s %10.2f %10.2f %10.2f %6d %10lld\n", files[i].spec->name, files[i].expected,
+               estimate.duration, estimate.error_bound, estimate.exact, estimate.bytes_read);
+        
+        double miss = estimate.duration - files[i].expected;
+        if (miss < 0) miss = -miss;
+        if (miss > estimate.error_bound + BENCH_ESTIMATE_SLACK) {
+            printf("ESTIMATE %-24s expected %.3fs outside %.3f +/- %.3fs\n", files[i].spec->name,
+                   files[i].expected, estimate.duration, estimate.error_bound);
+            mismatches++;
+        }
+    }
+    printf("\n");
+    
+    // 推式流解析：整个文件分块喂进去，收尾的结果要和GetAudioDuration一致
+    unsigned char* chunk = (unsigned char*)malloc(BENCH_STREAM_CHUNK);
+    printf("%-28s %10s %10s\n", "file (stream parser)", "chunks", "duration");
+    for (int i = 0; chunk && i < file_count; i++) {
+        FILE* file = fopen(files[i].path, "rb");
+        if (!file) continue;
+        
+        StreamParser* parser = CreateStreamParser(files[i].spec->name);
+        long long chunks = 0;
+        size_t got;
+        while ((got = fread(chunk, 1, BENCH_STREAM_CHUNK, file)) > 0) {
+            FeedStreamParser(parser, chunk, got);
+            chunks++;
+        }
+        fclose(file);
+        
+        AudioStreamInfo info;
+        info.struct_size = sizeof(info);
+        int error = FinishStreamParser(parser, &info);
+        FreeStreamParser(parser);
+        
+        printf("%-28s %10lld %10.3f\n", files[i].spec->name, chunks, error == AUDIO_OK ? info.duration : 0.0);
+        if (error != AUDIO_OK || (int)info.duration != GetAudioDuration(files[i].path)) {
+            printf("MISMATCH %-24s stream parser disagrees with GetAudioDuration\n", files[i].spec->name);
+            mismatches++;
+        }
+    }
+    free(chunk);
+    printf("\n");
+    
+    // 自定义I/O：默认预取策略下每个文件的区间请求数和取回的字节数
+    printf("%-28s %10s %12s %10s\n", "file (range reads)", "requests", "bytes", "duration");
+    for (int i = 0; i < file_count; i++) {
+        RangeFile range;
+        memset(&range, 0, sizeof(range));
+        range.file = fopen(files[i].path, "rb");
+        if (!range.file) continue;
+        range.size = files[i].size;
+        
+        AudioIO io;
+        memset(&io, 0, sizeof(io));
+        io.struct_size = sizeof(io);
+        io.read_at = range_read_at;
+        io.size = range_size;
+        io.user = &range;
+        int duration = GetAudioDurationFromIO(&io, files[i].spec->name);
+        fclose(range.file);
+        
+        printf("%-28s %10d %12lld %10d\n", files[i].spec->name, range.requests, range.bytes, duration);
+        if (duration != GetAudioDuration(files[i].path)) {
+            printf("MISMATCH %-24s range reads disagree with GetAudioDuration\n", files[i].spec->name);
+            mismatches++;
+        }
+    }
+    printf("\n");
+    
+    long long* samples = (long long*)malloc(sizeof(long long) * (size_t)iterations);
+    BenchResult* results = (BenchResult*)malloc(sizeof(BenchResult) * (size_t)file_count * 4);
+    int result_count = 0;
+    int cold_supported = drop_page_cache(files[0].path);
+    
+    printf("%-48s %10s %10s %10s %10s %9s\n", "file / entry / cache", "p50 us", "p99 us", "files/s",
+           "file MB/s", "reads");
+    for (int i = 0; i < file_count; i++) {
+        EntryPoint entries[2];
+        entries[0].name = "GetAudioDuration";
+        entries[0].fn = GetAudioDuration;
+        format_entry_for(files[i].spec, &entries[1]);
+        
+        for (int e = 0; e < 2; e++) {
+            for (int cold = 0; cold <= cold_supported; cold++) {
+                BenchResult* r = &results[result_count];
+                if (!run_one(&files[i], &entries[e], cold, iterations, samples, r)) continue;
+                result_count++;
+                
+                char reads[32];
+                if (r->syscalls >= 0) snprintf(reads, sizeof(reads), "%.1f", r->syscalls);
+                else snprintf(reads, sizeof(reads), "n/a");
+                printf("%-48s %10.1f %10.1f %10.0f %10.1f %9s\n", r->key, r->p50_us, r->p99_us,
+                       r->files_per_s, r->mb_per_s, reads);
+            }
+        }
+    }
+    if (!cold_supported) printf("\n(cold page cache runs need posix_fadvise; skipped on this platform)\n");
+    
+    if (baseline_path) compare_baseline(baseline_path, results, result_count);
+    if (save_path) save_baseline(save_path, results, result_count);
+    
+    free(samples);
+    free(results);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,334 @@
+// audio_parser_native.c - CPython扩展模块：批量解析一组文件或内存缓冲区
+//
+// 构建（与库放在同一个编译单元里）：
+//   gcc -O2 -shared -fPIC -pthread $(python3-config --includes) -o audio_parser_native$(python3-config --extension-suffix) python/audio_parser_native.c
+//   cl /O2 /LD /I<Python>\include python\audio_parser_native.c /link /LIBPATH:<Python>\libs /OUT:audio_parser_native.pyd
+//
+// 用法：
+//   import audio_parser_native as apn
+//   durations = apn.durations(items)                 # array('i')，与GetAudioDuration相同，失败为0
+//   info = apn.stream_info(items, threads=8)         # dict：字段名 -> array，下标与items一一对应
+//
+// items里每一项是文件路径（str或os.PathLike）或支持缓冲区协议的对象（bytes、bytearray、memoryview、
+// mmap等，内容就是音频数据；bytes不当路径用）。收集完参数后释放GIL，在原生线程上并行解析，
+// 每个线程一个解析上下文；threads <= 0 时按CPU核数。结果直接写进array.array的缓冲区
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include "../audio_parser.c"
+
+#define NATIVE_CHUNK 16     // 工作线程每次领取的项数，项很小时减少抢锁
+
+typedef struct {
+    PyObject* path;         // 路径项：os.fsencode后的bytes；缓冲区项为NULL
+    Py_buffer view;
+} NativeItem;
+
+typedef struct {
+    NativeItem* items;
+    Py_ssize_t count;
+    int* durations;             // durations()的输出
+    AudioStreamInfo* infos;     // stream_info()的输出
+    ap_mutex lock;
+    Py_ssize_t next;
+} NativeJob;
+
+// stream_info()返回的各列：元素宽度与AudioStreamInfo里的字段相同，直接按字节拷贝
+typedef struct {
+    const char* name;
+    const char* typecode;
+    size_t offset;
+    size_t size;
+} NativeColumn;
+
+static const NativeColumn native_columns[] = {
+    { "error",           "i", offsetof(AudioStreamInfo, error),           sizeof(int) },
+    { "codec",           "i", offsetof(AudioStreamInfo, codec),           sizeof(int) },
+    { "sample_rate",     "I", offsetof(AudioStreamInfo, sample_rate),     sizeof(unsigned int) },
+    { "channels",        "I", offsetof(AudioStreamInfo, channels),        sizeof(unsigned int) },
+    { "bits_per_sample", "I", offsetof(AudioStreamInfo, bits_per_sample), sizeof(unsigned int) },
+    { "bitrate",         "I", offsetof(AudioStreamInfo, bitrate),         sizeof(unsigned int) },
+    { "is_vbr",          "i", offsetof(AudioStreamInfo, is_vbr),          sizeof(int) },
+    { "estimated",       "i", offsetof(AudioStreamInfo, estimated),       sizeof(int) },
+    { "total_samples",   "Q", offsetof(AudioStreamInfo, total_samples),   sizeof(unsigned long long) },
+    { "duration",        "d", offsetof(AudioStreamInfo, duration),        sizeof(double) },
+    { "duration_ns",     "Q", offsetof(AudioStreamInfo, duration_ns),     sizeof(unsigned long long) },
+    { "leading_samples", "I", offsetof(AudioStreamInfo, leading_samples), sizeof(unsigned int) },
+    { "trailing_samples", "I", offsetof(AudioStreamInfo, trailing_samples), sizeof(unsigned int) },
+};
+
+#define NATIVE_COLUMN_COUNT ((int)(sizeof(native_columns) / sizeof(native_columns[0])))
+
+static void native_release_items(NativeItem* items, Py_ssize_t count) {
+    for (Py_ssize_t i = 0; i < count; i++) {
+        if (items[i].path) {
+            Py_DECREF(items[i].path);
+        } else {
+            PyBuffer_Release(&items[i].view);
+        }
+    }
+    PyMem_Free(items);
+}
+
+// 持有GIL时把参数转成原生可用的形式：路径编码成bytes，缓冲区取得只读视图（解析期间对象不能改大小）
+static NativeItem* native_collect_items(PyObject* sequence, Py_ssize_t* count) {
+    PyObject* fast = PySequence_Fast(sequence, "items must be a sequence");
+    if (!fast) return NULL;
+    
+    Py_ssize_t n = PySequence_Fast_GET_SIZE(fast);
+    NativeItem* items = (NativeItem*)PyMem_Calloc(n > 0 ? (size_t)n : 1, sizeof(NativeItem));
+    if (!items) {
+        Py_DECREF(fast);
+        PyErr_NoMemory();
+        return NULL;
+    }
+    
+    for (Py_ssize_t i = 0; i < n; i++) {
+        PyObject* obj = PySequence_Fast_GET_ITEM(fast, i);
+        int ok;
+        
+        if (PyUnicode_Check(obj) || (!PyObject_CheckBuffer(obj) && PyObject_HasAttrString(obj, "__fspath__"))) {
+            ok = PyUnicode_FSConverter(obj, &items[i].path);
+        } else if (PyObject_CheckBuffer(obj)) {
+            ok = PyObject_GetBuffer(obj, &items[i].view, PyBUF_SIMPLE) == 0;
+        } else {
+            PyErr_Format(PyExc_TypeError, "item %zd: expected a path or a bytes-like object, not %.200s", i,
+                         Py_TYPE(obj)->tp_name);
+            ok = 0;
+        }
+        
+        if (!ok) {
+            native_release_items(items, i);
+            Py_DECREF(fast);
+            return NULL;
+        }
+    }
+    
+    Py_DECREF(fast);
+    *count = n;
+    return items;
+}
+
+static void native_parse_item(NativeJob* job, Py_ssize_t i) {
+    NativeItem* item = &job->items[i];
+    
+    if (job->infos) {
+        AudioStreamInfo* info = &job->infos[i];
+        info->struct_size = sizeof(AudioStreamInfo);
+        if (item->path) {
+            get_audio_stream_info(PyBytes_AS_STRING(item->path), info);
+        } else {
+            get_audio_stream_info_from_buffer(item->view.buf, (size_t)item->view.len, info);
+        }
+    } else if (item->path) {
+        job->durations[i] = cached_audio_duration(PyBytes_AS_STRING(item->path));
+    } else {
+        job->durations[i] = get_audio_duration_from_buffer(item->view.buf, (size_t)item->view.len);
+    }
+}
+
+// 不碰任何Python对象，可以在释放GIL后运行
+static AP_THREAD_PROC native_worker(void* arg) {
+    NativeJob* job = (NativeJob*)arg;
+    ParserContext* context = create_parser_context();
+    ParserContext* previous = context_enter(context);
+    
+    for (;;) {
+        ap_mutex_lock(&job->lock);
+        Py_ssize_t begin = job->next;
+        job->next += NATIVE_CHUNK;
+        ap_mutex_unlock(&job->lock);
+        if (begin >= job->count) break;
+        
+        Py_ssize_t end = begin + NATIVE_CHUNK < job->count ? begin + NATIVE_CHUNK : job->count;
+        for (Py_ssize_t i = begin; i < end; i++) {
+            native_parse_item(job, i);
+        }
+    }
+    
+    context_leave(previous);
+    free_parser_context(context);
+    return AP_THREAD_EXIT;
+}
+
+// 调用线程自己也当一个工作线程；线程起不来时剩下的项由已有线程做完
+static void native_run(NativeJob* job, int num_threads, ap_thread* threads) {
+    ap_mutex_init(&job->lock);
+    job->next = 0;
+    
+    int started = 0;
+    for (int i = 1; i < num_threads; i++) {
+        if (ap_thread_start(&threads[started], native_worker, job)) started++;
+    }
+    native_worker(job);
+    for (int i = 0; i < started; i++) {
+        ap_thread_join(threads[i]);
+    }
+    ap_mutex_destroy(&job->lock);
+}
+
+static int native_thread_count(int threads, Py_ssize_t count) {
+    if (threads <= 0) threads = ap_cpu_count();
+    if (threads > AP_MAX_THREADS) threads = AP_MAX_THREADS;
+    if ((Py_ssize_t)threads > (count + NATIVE_CHUNK - 1) / NATIVE_CHUNK) {
+        threads = (int)((count + NATIVE_CHUNK - 1) / NATIVE_CHUNK);
+    }
+    return threads > 0 ? threads : 1;
+}
+
+// 释放GIL并行解析；job->durations或job->infos由调用方准备好
+static int native_parse_all(NativeJob* job, int threads) {
+    int num_threads = native_thread_count(threads, job->count);
+    ap_thread* handles = (ap_thread*)PyMem_Malloc(sizeof(ap_thread) * (size_t)num_threads);
+    if (!handles) {
+        PyErr_NoMemory();
+        return 0;
+    }
+    
+    Py_BEGIN_ALLOW_THREADS
+    native_run(job, num_threads, handles);
+    Py_END_ALLOW_THREADS
+    
+    PyMem_Free(handles);
+    return 1;
+}
+
+// 建一个count个元素、全为0的array.array，并取得它的可写缓冲区；导出期间数组不能改大小
+static PyObject* native_new_array(const char* typecode, Py_ssize_t count, size_t item_size, Py_buffer* view) {
+    PyObject* array_module = PyImport_ImportModule("array");
+    if (!array_module) return NULL;
+    
+    PyObject* zeros = PyBytes_FromStringAndSize(NULL, count * (Py_ssize_t)item_size);
+    PyObject* array = NULL;
+    if (zeros) {
+        memset(PyBytes_AS_STRING(zeros), 0, (size_t)count * item_size);
+        array = PyObject_CallMethod(array_module, "array", "sO", typecode, zeros);
+        Py_DECREF(zeros);
+    }
+    Py_DECREF(array_module);
+    if (!array) return NULL;
+    
+    if (PyObject_GetBuffer(array, view, PyBUF_WRITABLE) != 0) {
+        Py_DECREF(array);
+        return NULL;
+    }
+    if ((size_t)view->itemsize != item_size) {
+        PyBuffer_Release(view);
+        Py_DECREF(array);
+        PyErr_Format(PyExc_SystemError, "array typecode '%s' has unexpected item size", typecode);
+        return NULL;
+    }
+    return array;
+}
+
+static PyObject* native_durations(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* keywords[] = { "items", "threads", NULL };
+    PyObject* sequence;
+    int threads = 0;
+    (void)self;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i:durations", keywords, &sequence, &threads)) return NULL;
+    
+    NativeJob job;
+    memset(&job, 0, sizeof(job));
+    job.items = native_collect_items(sequence, &job.count);
+    if (!job.items) return NULL;
+    
+    Py_buffer view;
+    PyObject* result = native_new_array("i", job.count, sizeof(int), &view);
+    if (result) {
+        job.durations = (int*)view.buf;
+        int ok = native_parse_all(&job, threads);
+        PyBuffer_Release(&view);
+        if (!ok) Py_CLEAR(result);
+    }
+    
+    native_release_items(job.items, job.count);
+    return result;
+}
+
+// 先解析进一个AudioStreamInfo数组，再按列拆进各个array
+static PyObject* native_stream_info(PyObject* self, PyObject* args, PyObject* kwargs) {
+    static char* keywords[] = { "items", "threads", NULL };
+    PyObject* sequence;
+    int threads = 0;
+    (void)self;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O|i:stream_info", keywords, &sequence, &threads)) return NULL;
+    
+    NativeJob job;
+    memset(&job, 0, sizeof(job));
+    job.items = native_collect_items(sequence, &job.count);
+    if (!job.items) return NULL;
+    
+    PyObject* result = NULL;
+    job.infos = (AudioStreamInfo*)PyMem_Calloc(job.count > 0 ? (size_t)job.count : 1, sizeof(AudioStreamInfo));
+    if (!job.infos) {
+        PyErr_NoMemory();
+    } else if (native_parse_all(&job, threads)) {
+        result = PyDict_New();
+        for (int c = 0; result && c < NATIVE_COLUMN_COUNT; c++) {
+            const NativeColumn* column = &native_columns[c];
+            Py_buffer view;
+            PyObject* array = native_new_array(column->typecode, job.count, column->size, &view);
+            if (!array) {
+                Py_CLEAR(result);
+                break;
+            }
+            
+            char* out = (char*)view.buf;
+            for (Py_ssize_t i = 0; i < job.count; i++) {
+                memcpy(out + (size_t)i * column->size, (const char*)&job.infos[i] + column->offset, column->size);
+            }
+            PyBuffer_Release(&view);
+            
+            if (PyDict_SetItemString(result, column->name, array) != 0) Py_CLEAR(result);
+            Py_DECREF(array);
+        }
+    }
+    
+    PyMem_Free(job.infos);
+    native_release_items(job.items, job.count);
+    return result;
+}
+
+static PyMethodDef native_methods[] = {
+    { "durations", (PyCFunction)(void (*)(void))native_durations, METH_VARARGS | METH_KEYWORDS,
+      "durations(items, threads=0) -> array('i')\n\n"
+      "Whole-second durations of each path or bytes-like object, 0 where parsing failed." },
+    { "stream_info", (PyCFunction)(void (*)(void))native_stream_info, METH_VARARGS | METH_KEYWORDS,
+      "stream_info(items, threads=0) -> dict of arrays\n\n"
+      "One array per AudioStreamInfo field (error, codec, sample_rate, channels, bits_per_sample,\n"
+      "bitrate, is_vbr, estimated, total_samples, duration, duration_ns, leading_samples,\n"
+      "trailing_samples), indexed like items." },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef native_module = {
+    PyModuleDef_HEAD_INIT,
+    "audio_parser_native",
+    "Batch audio duration parsing that releases the GIL and returns array.array results.",
+    -1,
+    native_methods,
+    NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_audio_parser_native(void) {
+    PyObject* module = PyModule_Create(&native_module);
+    if (!module) return NULL;
+    
+    if (PyModule_AddIntConstant(module, "OK", AUDIO_OK) != 0 ||
+        PyModule_AddIntConstant(module, "ERR_INVALID_ARG", AUDIO_ERR_INVALID_ARG) != 0 ||
+        PyModule_AddIntConstant(module, "ERR_OPEN", AUDIO_ERR_OPEN) != 0 ||
+        PyModule_AddIntConstant(module, "ERR_UNKNOWN_FORMAT", AUDIO_ERR_UNKNOWN_FORMAT) != 0 ||
+        PyModule_AddIntConstant(module, "ERR_PARSE", AUDIO_ERR_PARSE) != 0 ||
+        PyModule_AddIntConstant(module, "CODEC_UNKNOWN", AUDIO_CODEC_UNKNOWN) != 0 ||
+        PyModule_AddIntConstant(module, "CODEC_PCM", AUDIO_CODEC_PCM) != 0 ||
+        PyModule_AddIntConstant(module, "CODEC_FLAC", AUDIO_CODEC_FLAC) != 0 ||
+        PyModule_AddIntConstant(module, "CODEC_VORBIS", AUDIO_CODEC_VORBIS) != 0 ||
+        PyModule_AddIntConstant(module, "CODEC_OPUS", AUDIO_CODEC_OPUS) != 0 ||
+        PyModule_AddIntConstant(module, "CODEC_MP1", AUDIO_CODEC_MP1) != 0 ||
+        PyModule_AddIntConstant(module, "CODEC_MP2", AUDIO_CODEC_MP2) != 0 ||
+        PyModule_AddIntConstant(module, "CODEC_MP3", AUDIO_CODEC_MP3) != 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}